@@ -1,266 +1,756 @@
 /* The code that test the sorting algorithms in kernel space
  */
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include <math.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/utsname.h>
+
+#include "hist.h"
+#include "results.h"
+#include "sort_test_ioctl.h"
 
 #define SORT_DEV "/dev/sort_test"
+#define SORT_PARAMS "/sys/module/sort_test/parameters"
+/* Convert it with `./convert csv results.bin` */
+#define RESULTS_FILE "results.bin"
 
-#define MAX_LEN ((1 << 14) + 10)
+/* The sizes the driver supports, see `sort.h` */
+#define MAX_LEN ((1 << 20) + 20)
 #define MIN_LEN 4
+/* The sizes beyond `MAX_LEN` need the `arena` parameter of the driver, and
+ * take seconds per sort, so they run fewer iterations */
+#define LARGE_MAX_LEN (1 << 28)
+#define LARGE_LOOP 5
+/* The sizes of `continuous` */
+#define CONTINUOUS_MAX ((1 << 14) + 10)
 #define LOOP 100
 
-#define LISTSORT "ls_data"
-#define TIMMERGE "tm_data"
-#define TIMLINEAR "tl_data"
-#define TIMBINARY "tb_data"
-#define TIMLGALLOP "tlg_data"
-#define TIMBGALLOP "tbg_data"
-#define ADAPSHIVER "ads_data"
-#define ADSMERGE "adsm_data"
-
-unsigned long long int duration[LOOP];
-unsigned long long int count[LOOP];
-double k[LOOP];
-
-typedef struct {
-    char *name;
-} directory;
-
-directory dirs[] = {
-    {.name = LISTSORT}, 
-    {.name = TIMMERGE}, 
-    {.name = TIMLINEAR}, 
-    {.name = TIMBINARY}, 
-    {.name = TIMLGALLOP}, 
-    {.name = TIMBGALLOP}, 
-    {.name = ADAPSHIVER}, 
-    {.name = ADSMERGE},
-    {.name = NULL}
+/* The extra sizes around a cache boundary are spaced by 2^(1/8), up to 2^(1/2)
+ * away from it */
+#define BOUNDARY_STEPS 4
+#define BOUNDARY_STEP 8
+
+/* The result of one sort read from the device driver */
+struct sort_result {
+    unsigned long long int duration;
+    unsigned long long int count;
+    /* the run profile of the input and the merge cost of the sort */
+    unsigned long long int runs;
+    double nh;
+    unsigned long long int cost;
+    /* the longest stretch between the rescheduling points of the sort */
+    unsigned long long int max_gap;
+    unsigned long long int resched;
+    unsigned long long int yield;
+    /* the CPUs sorting at once, the result being of the slowest */
+    unsigned long long int cpus;
+    unsigned long long int cpu; /* the CPU the sort started on */
+    unsigned long long int dtlb; /* 0 unless the driver counts them */
+    struct sort_phase_stats phases;
 };
 
-static void file_output(size_t num, int case_id, char *dir_name)
+/* The statistics of all the iterations of one (engine, case, size) */
+struct summary {
+    struct hist duration, max_gap;
+    struct moments time, count, k, runs, cmp_ratio, cost_ratio, resched, yield,
+        dtlb;
+    double phase_cmps[SORT_PHASE_NR];
+    double phase_visits[SORT_PHASE_NR];
+    double phase_writes[SORT_PHASE_NR];
+    unsigned int cpus, cpu;
+};
+
+struct summary summary;
+
+/* The single results file of the client */
+static FILE *results;
+
+/* The seed of the samples. Iteration `i` of every (engine, case, size) sorts
+ * the `i`-th stream of the seed, so `-s <seed> -i <i>` replays it alone. */
+static unsigned long long sample_seed;
+static int replay_iteration = -1;
+
+/* The device the iterations are submitted to as jobs with `-a`, or -1 */
+static int job_fd = -1;
+
+/* Read the first line of the text file `name` into `buf`, without the newline,
+ * and return if any is read */
+static bool read_line(const char *name, char *buf, size_t size)
 {
-    char cnt_file[100];
-    char time_file[100];
-    char k_file[100];
-
-    switch (case_id) {
-    case 0: /* Worst case of merge sort */
-        sprintf(cnt_file, "%s/w_count.txt", dir_name);
-        sprintf(time_file, "%s/w_time.txt", dir_name);
-        sprintf(k_file, "%s/w_kvalue.txt", dir_name);
-        break;
-    case 1: /* Random 3 elements */
-        sprintf(cnt_file, "%s/r3_count.txt", dir_name);
-        sprintf(time_file, "%s/r3_time.txt", dir_name);
-        sprintf(k_file, "%s/r3_kvalue.txt", dir_name);
-        break;
-    case 2: /* Random last 10 elements */
-        sprintf(cnt_file, "%s/rl10_count.txt", dir_name);
-        sprintf(time_file, "%s/rl10_time.txt", dir_name);
-        sprintf(k_file, "%s/rl10_kvalue.txt", dir_name);
-        break;
-    case 3: /* Random 1% elements */
-        sprintf(cnt_file, "%s/r1p_count.txt", dir_name);
-        sprintf(time_file, "%s/r1p_time.txt", dir_name);
-        sprintf(k_file, "%s/r1p_kvalue.txt", dir_name);
-        break;
-    case 4: /* Duplicate */
-        sprintf(cnt_file, "%s/dup_count.txt", dir_name);
-        sprintf(time_file, "%s/dup_time.txt", dir_name);
-        sprintf(k_file, "%s/dup_kvalue.txt", dir_name);
-        break;
-    default: /* Random elements */
-        sprintf(cnt_file, "%s/r_count.txt", dir_name);
-        sprintf(time_file, "%s/r_time.txt", dir_name);
-        sprintf(k_file, "%s/r_kvalue.txt", dir_name);
-        break;
+    FILE *file = fopen(name, "r");
+    if (!file)
+        return false;
+
+    bool res = fgets(buf, size, file);
+    buf[strcspn(buf, "\n")] = '\0';
+    fclose(file);
+    return res;
+}
+
+/* Describe this machine and the parameters of the driver in a run block */
+static void run_output(void)
+{
+    struct results_run run;
+    struct utsname uts;
+
+    memset(&run, 0, sizeof(run));
+    run.time = time(NULL);
+    if (!uname(&uts))
+        snprintf(run.kernel, sizeof(run.kernel), "%s", uts.release);
+
+    FILE *cpuinfo = fopen("/proc/cpuinfo", "r");
+    char line[256];
+    while (cpuinfo && fgets(line, sizeof(line), cpuinfo)) {
+        char *model = strchr(line, ':');
+        if (!strncmp(line, "model name", 10) && model) {
+            model[strcspn(model, "\n")] = '\0';
+            snprintf(run.cpu_model, sizeof(run.cpu_model), "%s", model + 2);
+            break;
+        }
     }
+    if (cpuinfo)
+        fclose(cpuinfo);
 
-    FILE *cnt = fopen(cnt_file, "a");
-    FILE *time = fopen(time_file, "a");
-    FILE *kvalue = fopen(k_file, "a");
+    DIR *params = opendir(SORT_PARAMS);
+    struct dirent *param;
+    size_t len = 0;
+    while (params && (param = readdir(params))) {
+        char name[512], value[64];
+        snprintf(name, sizeof(name), SORT_PARAMS "/%s", param->d_name);
+        if (param->d_name[0] == '.' || !read_line(name, value, sizeof(value)))
+            continue;
+        len += snprintf(run.params + len, sizeof(run.params) - len, "%s%s=%s",
+                        len ? " " : "", param->d_name, value);
+        if (len >= sizeof(run.params))
+            break;
+    }
+    if (params)
+        closedir(params);
+
+    results_write_run(results, &run);
+}
 
-    if (!cnt) {
-        perror("The output file `(.)_count.txt` might have been collapsed");
+/* Save the record of one (engine, case, size): the percentiles of the
+ * durations, and the means with the half width of their 95% confidence
+ * intervals. The comparisons and the merge cost are normalized by n * H, the
+ * product of the size and the run-length entropy of the input, which the
+ * Powersort and ShiversSort bounds are given in; they are `nan` if the inputs
+ * are a single run. The gaps are the longest stretches of each sort without a
+ * rescheduling point, in nanoseconds. The dTLB misses are only counted with
+ * `count_dtlb` of the driver. */
+static void record_output(size_t num, int case_id, int sort_id, int loop)
+{
+    struct results_record rec;
+
+    memset(&rec, 0, sizeof(rec));
+    snprintf(rec.engine, sizeof(rec.engine), "%s", engine_names[sort_id]);
+    snprintf(rec.case_name, sizeof(rec.case_name), "%s", case_names[case_id]);
+    rec.cpu = summary.cpu;
+    rec.loop = loop;
+    rec.size = num;
+    rec.seed = sample_seed;
+    rec.time_p50 = hist_percentile(&summary.duration, 50);
+    rec.time_p90 = hist_percentile(&summary.duration, 90);
+    rec.time_p99 = hist_percentile(&summary.duration, 99);
+    rec.time_p999 = hist_percentile(&summary.duration, 99.9);
+    rec.time_max = summary.duration.max;
+    rec.gap_p50 = hist_percentile(&summary.max_gap, 50);
+    rec.gap_p99 = hist_percentile(&summary.max_gap, 99);
+    rec.gap_max = summary.max_gap.max;
+    rec.time_mean = summary.time.mean;
+    rec.time_ci95 = moments_ci95(&summary.time);
+    rec.count_mean = summary.count.mean;
+    rec.count_ci95 = moments_ci95(&summary.count);
+    rec.k_mean = summary.k.mean;
+    rec.runs_mean = summary.runs.mean;
+    rec.cmp_nh_mean = summary.cmp_ratio.n ? summary.cmp_ratio.mean : NAN;
+    rec.cost_nh_mean = summary.cost_ratio.n ? summary.cost_ratio.mean : NAN;
+    rec.resched_mean = summary.resched.mean;
+    rec.yield_mean = summary.yield.mean;
+    rec.cpus = summary.cpus;
+    rec.tlb_mean = summary.dtlb.mean;
+    /* the mean work of each phase over the iterations */
+    for (int p = 0 ; p < SORT_PHASE_NR ; p++) {
+        rec.phase_cmps[p] = summary.phase_cmps[p] / loop;
+        rec.phase_visits[p] = summary.phase_visits[p] / loop;
+        rec.phase_writes[p] = summary.phase_writes[p] / loop;
+    }
+
+    results_write_record(results, &rec, &summary.duration);
+    /* keep the finished records of a long sweep if it is interrupted */
+    fflush(results);
+}
+
+/* To get the k-value from the current number of comparisons and nodes */
+double k_value(size_t n, size_t comp)
+{
+    return log2(n) - (double) (comp - 1) / n;
+}
+
+/* Parse the result line of the device driver, see `sort_test_ioctl.h` */
+static void parse_result(char *line, struct sort_result *res)
+{
+    char *token, *endptr; 
+    int counter = 0; /* the printing state of the tokens */
+    res->cpus = 1;
+    res->cpu = sched_getcpu();
+    res->dtlb = 0;
+    token = strtok(line, " \t\r\n\a");
+    while(token != NULL){
+        if(counter > 10) 
+            break;
+
+        unsigned long long int num = strtoull(token, &endptr, 10);
+        if (counter == 0)
+            res->duration = num;
+        else if(counter == 1)
+            res->count = num;
+        else if (counter == 2)
+            res->runs = num;
+        else if (counter == 3)
+            res->nh = (double) num / (1 << SORT_TEST_NH_SHIFT);
+        else if (counter == 4)
+            res->cost = num;
+        else if (counter == 5)
+            res->max_gap = num;
+        else if (counter == 6)
+            res->resched = num;
+        else if (counter == 7)
+            res->yield = num;
+        else if (counter == 8)
+            res->cpus = num;
+        else if (counter == 9)
+            res->cpu = num;
+        else
+            res->dtlb = num;
+        
+        token = strtok(NULL, " \t\r\n\a");
+        counter++;
+    }
+}
+
+
+/* Run one test on the device driver */
+static void sort_test_iteration(int num, int case_id, int sort_id,
+                                int iteration, struct sort_result *res)
+{
+    int fd = open(SORT_DEV, O_RDWR);
+    if (fd < 0) {
+        perror("Failed to open character device");
         exit(EXIT_FAILURE);
     }
 
-    if (!time) {
-        perror("The output file `(.)_time.txt` might have been collapsed");
+    char buf_write[512];
+    sprintf(buf_write, "%d %d %d %llu %d", num, case_id, sort_id, sample_seed,
+            iteration);
+    /* write the properties of the current test case to device driver */
+    ssize_t w_sz = write(fd, buf_write, 512);
+    if (w_sz < 0) {
+        perror("Failed to write to the device");
+        close(fd);
         exit(EXIT_FAILURE);
     }
 
-    if (!kvalue) {
-        perror("The output file `(.)_kvalue.txt` might have been collapsed");
+    char buf_read[512];
+    /* read the output of the test from device driver */
+    ssize_t r_sz = read(fd, &buf_read, sizeof(buf_read) - 1);
+    if (r_sz < 0) {
+        perror("Failed to read from the device");
+        close(fd);
         exit(EXIT_FAILURE);
     }
+    /* the driver reads nothing when the list wasn't sorted */
+    if (!r_sz) {
+        fprintf(stderr, "%s %s %d iteration %d failed: %s\n",
+                engine_names[sort_id], case_names[case_id], num, iteration,
+                strerror(EILSEQ));
+        close(fd);
+        exit(EXIT_FAILURE);
+    }
+    buf_read[r_sz] = '\0';
+    parse_result(buf_read, res);
 
-    for (int i = 0 ; i < LOOP ; i++) {
-        fprintf(cnt, "%lu %llu\n", num, count[i]);
-        fprintf(time, "%lu %llu\n", num, duration[i]);
-        fprintf(kvalue, "%lu %f\n", num, k[i]);
+    /* fetch the work of each phase of the sort */
+    if (ioctl(fd, SORT_TEST_IOC_PHASES, &res->phases) < 0) {
+        perror("Failed to get the phase statistics from the device");
+        close(fd);
+        exit(EXIT_FAILURE);
     }
+    close(fd);
+}
 
-    fclose(cnt);
-    fclose(time);
-    fclose(kvalue);
+static void summary_reset(void)
+{
+    hist_reset(&summary.duration);
+    hist_reset(&summary.max_gap);
+    moments_reset(&summary.time);
+    moments_reset(&summary.count);
+    moments_reset(&summary.k);
+    moments_reset(&summary.runs);
+    moments_reset(&summary.cmp_ratio);
+    moments_reset(&summary.cost_ratio);
+    moments_reset(&summary.resched);
+    moments_reset(&summary.yield);
+    moments_reset(&summary.dtlb);
+    memset(summary.phase_cmps, 0, sizeof(summary.phase_cmps));
+    memset(summary.phase_visits, 0, sizeof(summary.phase_visits));
+    memset(summary.phase_writes, 0, sizeof(summary.phase_writes));
 }
 
-/* To get the k-value from the current number of comparisons and nodes */
-double k_value(size_t n, size_t comp)
+/* Add the result of an iteration of `num` nodes to the summary */
+static void summary_add(int num, const struct sort_result *res)
 {
-    return log2(n) - (double) (comp - 1) / n;
+    hist_record(&summary.duration, res->duration);
+    moments_add(&summary.time, res->duration);
+    moments_add(&summary.count, res->count);
+    moments_add(&summary.k, k_value((size_t) num, (size_t) res->count));
+    moments_add(&summary.runs, res->runs);
+    /* a single run has no entropy, leaving the ratios undefined */
+    moments_add(&summary.cmp_ratio, res->nh ? res->count / res->nh : NAN);
+    moments_add(&summary.cost_ratio, res->nh ? res->cost / res->nh : NAN);
+    hist_record(&summary.max_gap, res->max_gap);
+    moments_add(&summary.resched, res->resched);
+    moments_add(&summary.yield, res->yield);
+    moments_add(&summary.dtlb, res->dtlb);
+    summary.cpus = res->cpus;
+    summary.cpu = res->cpu;
+
+    for (int p = 0 ; p < SORT_PHASE_NR ; p++) {
+        summary.phase_cmps[p] += res->phases.cmps[p];
+        summary.phase_visits[p] += res->phases.visits[p];
+        summary.phase_writes[p] += res->phases.writes[p];
+    }
 }
 
-static void sort_test_one_num(int num)
+/* Run all the iterations of one (engine, case, size) and save their summary */
+static void sort_test_num(int num, int case_id, int sort_id)
 {
-    if (num < MIN_LEN || num > MAX_LEN) {
-        perror("Given number argument out of the range of number of nodes in this code");
-        exit(EXIT_FAILURE);
+    summary_reset();
+
+    int loop = num > MAX_LEN ? LARGE_LOOP : LOOP;
+    for (int i = 0 ; i < loop ; i++) {
+        struct sort_result res;
+        sort_test_iteration(num, case_id, sort_id, i, &res);
+        summary_add(num, &res);
     }
-    
-    int sort_id = 0;
-    for (int case_id = 0 ; case_id < 6 ; case_id++) {
-        for (directory *dir = dirs ; dir->name ; sort_id++, dir++) {
-            for (int i = 0 ; i < LOOP ; i++) {
-                int fd = open(SORT_DEV, O_RDWR);
-                if (fd < 0) {
-                    perror("Failed to open character device");
-                    exit(EXIT_FAILURE);
-                }
-
-                char buf_write[512];
-                sprintf(buf_write, "%d %d %d", num, case_id, sort_id);
-                /* write the properties of the current test case to device driver */
-                ssize_t w_sz = write(fd, buf_write, 512);
-                if (w_sz < 0) {
-                    perror("Failed to write to the device");
-                    close(fd);
-                    exit(EXIT_FAILURE);
-                }
-
-                char buf_read[512];
-                /* read the output of the test from device driver */
-                ssize_t r_sz = read(fd, &buf_read, 512);
-                if (r_sz < 0) {
-                    perror("Failed to read from the device");
-                    close(fd);
-                    exit(EXIT_FAILURE);
-                }
-
-                /* handle the string read from the kernel device */
-                char *token, *endptr; 
-                int counter = 0; /* the printing state of the tokens */
-                token = strtok(buf_read, " \t\r\n\a");
-                while(token != NULL){
-                    if(counter > 2) 
-                        break;
-
-                    unsigned long long int num = strtoull(token, &endptr, 10);
-                    if (counter == 0)
-                        duration[i] = num;
-                    else if(counter == 1)
-                        count[i] = num;
-                    
-                    token = strtok(NULL, " \t\r\n\a");
-                    counter++;
-                }
-
-                k[i] = k_value((size_t) num, (size_t) count[i]);
-                close(fd);
+
+    record_output(num, case_id, sort_id, loop);
+}
+
+/* sort_test_num() with the iterations submitted as jobs, which the driver runs
+ * on its `job_cpu` while the results of the ones before are summed up here */
+static void sort_test_num_async(int num, int case_id, int sort_id)
+{
+    summary_reset();
+
+    int loop = num > MAX_LEN ? LARGE_LOOP : LOOP;
+    int submitted = 0, fetched = 0;
+    while (fetched < loop) {
+        struct pollfd pfd = {
+            .fd = job_fd,
+            .events = POLLIN | (submitted < loop ? POLLOUT : 0),
+        };
+        if (poll(&pfd, 1, -1) < 0) {
+            perror("Failed to poll the device");
+            exit(EXIT_FAILURE);
+        }
+
+        while (submitted < loop) {
+            struct sort_test_job job = {
+                .nodes = num,
+                .case_id = case_id,
+                .sort_id = sort_id,
+                .iteration = submitted,
+                .seed = sample_seed,
+                .cookie = submitted,
+            };
+            if (ioctl(job_fd, SORT_TEST_IOC_SUBMIT, &job) < 0) {
+                if (errno == EAGAIN)
+                    break;
+                perror("Failed to submit a job to the device");
+                exit(EXIT_FAILURE);
+            }
+            submitted++;
+        }
+
+        struct sort_test_job_result job_res;
+        while (!ioctl(job_fd, SORT_TEST_IOC_RESULT, &job_res)) {
+            struct sort_result res;
+
+            if (job_res.status) {
+                fprintf(stderr, "%s %s %d iteration %llu failed: %s\n",
+                        engine_names[sort_id], case_names[case_id], num,
+                        (unsigned long long) job_res.cookie,
+                        strerror(-job_res.status));
+                exit(EXIT_FAILURE);
             }
-            file_output(num, case_id, dir->name);
+            parse_result(job_res.line, &res);
+            res.phases = job_res.phases;
+            summary_add(num, &res);
+            fetched++;
+        }
+        if (errno != EAGAIN) {
+            perror("Failed to fetch the result of a job from the device");
+            exit(EXIT_FAILURE);
         }
-        sort_id = 0;
     }
+
+    record_output(num, case_id, sort_id, loop);
 }
 
-static void sort_test_continuously()
+/* Open the device for the jobs of `-a`, moving this process off the CPU which
+ * runs them */
+static void open_jobs(void)
 {
-    int sort_id = 0;
-    for (int case_id = 0 ; case_id < 6 ; case_id++) {
-        for (directory *dir = dirs ; dir->name ; sort_id++, dir++) {
-            for (int num = MIN_LEN ; num < MAX_LEN ; num++) {
-                // printf("start %s in #%d\n", dir->name, num);
-                for (int i = 0 ; i < LOOP ; i++) {
-                    int fd = open(SORT_DEV, O_RDWR);
-                    if (fd < 0) {
-                        perror("Failed to open character device");
-                        exit(EXIT_FAILURE);
-                    }
-
-                    char buf_write[512];
-                    sprintf(buf_write, "%d %d %d", num, case_id, sort_id);
-                    /* write the properties of the current test case to device driver */
-                    ssize_t w_sz = write(fd, buf_write, 512);
-                    if (w_sz < 0) {
-                        perror("Failed to write to the device");
-                        close(fd);
-                        exit(EXIT_FAILURE);
-                    }
-
-                    char buf_read[512];
-                    /* read the output of the test from device driver */
-                    ssize_t r_sz = read(fd, &buf_read, 512);
-                    if (r_sz < 0) {
-                        perror("Failed to read from the device");
-                        close(fd);
-                        exit(EXIT_FAILURE);
-                    }
-
-                    /* handle the string read from the kernel device */
-                    char *token, *endptr; 
-                    int counter = 0; /* the printing state of the tokens */
-                    token = strtok(buf_read, " \t\r\n\a");
-                    while(token != NULL){
-                        if(counter > 2) 
-                            break;
-
-                        unsigned long long int num = strtoull(token, &endptr, 10);
-                        if (counter == 0)
-                            duration[i] = num;
-                        else if(counter == 1)
-                            count[i] = num;
-                        
-                        token = strtok(NULL, " \t\r\n\a");
-                        counter++;
-                    }
-
-                    k[i] = k_value((size_t) num, (size_t) count[i]);
-                    close(fd);
-                }
-                file_output(num, case_id, dir->name);
-            }
+    job_fd = open(SORT_DEV, O_RDWR);
+    if (job_fd < 0) {
+        perror("Failed to open character device");
+        exit(EXIT_FAILURE);
+    }
+
+    char value[64];
+    cpu_set_t cpus;
+    if (!read_line(SORT_PARAMS "/job_cpu", value, sizeof(value)) ||
+        sched_getaffinity(0, sizeof(cpus), &cpus))
+        return;
+    CPU_CLR(atoi(value), &cpus);
+    if (CPU_COUNT(&cpus))
+        sched_setaffinity(0, sizeof(cpus), &cpus);
+}
+
+/* Run the iteration `replay_iteration` of one (engine, case, size) again and
+ * print its result instead of recording it */
+static void sort_test_replay(int num, int case_id, int sort_id)
+{
+    struct sort_result res;
+
+    sort_test_iteration(num, case_id, sort_id, replay_iteration, &res);
+    printf("%s %s %d seed %llu iteration %d: %llu ns, %llu comparisons, "
+           "%llu runs, %llu ns max gap, %llu CPUs\n", engine_names[sort_id],
+           case_names[case_id], num, sample_seed, replay_iteration,
+           res.duration, res.count, res.runs, res.max_gap, res.cpus);
+}
+
+/* Load the keys of the trace file `name`, one decimal key per line, into the
+ * buffer of the driver, returning the number of keys */
+static long load_trace(const char *name)
+{
+    FILE *file = fopen(name, "r");
+    if (!file) {
+        perror("Failed to open the trace");
+        exit(EXIT_FAILURE);
+    }
+
+    int fd = open(SORT_DEV, O_RDWR);
+    if (fd < 0) {
+        perror("Failed to open character device");
+        exit(EXIT_FAILURE);
+    }
+    size_t size = MAX_LEN * sizeof(uint64_t);
+    uint64_t *keys = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (keys == MAP_FAILED) {
+        perror("Failed to map the trace buffer of the device");
+        exit(EXIT_FAILURE);
+    }
+
+    long nr = 0;
+    unsigned long long key;
+    while (nr < MAX_LEN && fscanf(file, "%llu", &key) == 1)
+        keys[nr++] = key;
+    if (nr == MAX_LEN && fscanf(file, "%llu", &key) == 1)
+        fprintf(stderr, "Only the first %d keys of the trace are used\n",
+                MAX_LEN);
+
+    munmap(keys, size);
+    close(fd);
+    fclose(file);
+    return nr;
+}
+
+/* The selected engines, cases and sizes of the sweep */
+static bool engine_selected[NR_ENGINES], case_selected[NR_CASES];
+static int *sizes;
+static size_t nr_sizes, cap_sizes;
+
+static void add_size(long num)
+{
+    if (num < MIN_LEN || num > LARGE_MAX_LEN) {
+        fprintf(stderr, "Size %ld is out of [%d, %d]\n", num, MIN_LEN,
+                LARGE_MAX_LEN);
+        exit(EXIT_FAILURE);
+    }
+
+    if (nr_sizes == cap_sizes) {
+        cap_sizes = cap_sizes ? cap_sizes * 2 : 1024;
+        sizes = realloc(sizes, cap_sizes * sizeof(*sizes));
+        if (!sizes) {
+            perror("Failed to add the size");
+            exit(EXIT_FAILURE);
+        }
+    }
+    sizes[nr_sizes++] = num;
+}
+
+static int size_cmp(const void *a, const void *b)
+{
+    return *(const int *) a - *(const int *) b;
+}
+
+/* Add `points` sizes from `min` to `max` spaced evenly on the log scale */
+static void add_log_sizes(long min, long max, int points)
+{
+    for (int i = 0 ; i < points ; i++)
+        add_size(lround(min * pow((double) max / min,
+                                  points > 1 ? (double) i / (points - 1) : 0)));
+}
+
+/* Parse a comma separated list of names or indexes into `selected` */
+static void select_names(char *list, const char *const *names, int nr,
+                         bool *selected)
+{
+    for (char *name = strtok(list, ",") ; name ; name = strtok(NULL, ",")) {
+        char *end;
+        long idx = strtol(name, &end, 10);
+        if (*end) {
+            for (idx = 0 ; idx < nr && strcmp(names[idx], name) ; idx++)
+                ;
+        }
+        if (idx < 0 || idx >= nr) {
+            fprintf(stderr, "Unknown name %s\n", name);
+            exit(EXIT_FAILURE);
+        }
+        selected[idx] = true;
+    }
+}
+
+/* Whether the driver carves the elements from an arena, which the sizes
+ * beyond `MAX_LEN` need */
+static bool arena_enabled(void)
+{
+    char value[64];
+
+    return read_line(SORT_PARAMS "/arena", value, sizeof(value)) && atoi(value);
+}
+
+/* The bytes of a node under the current parameters of the driver, including
+ * the rounding of its allocations and its keys elsewhere */
+static long node_bytes(void)
+{
+    uint64_t bytes;
+    int fd = open(SORT_DEV, O_RDWR);
+    if (fd < 0) {
+        perror("Failed to open character device");
+        exit(EXIT_FAILURE);
+    }
+    if (ioctl(fd, SORT_TEST_IOC_NODE_BYTES, &bytes) < 0) {
+        perror("Failed to get the bytes of a node");
+        exit(EXIT_FAILURE);
+    }
+    close(fd);
+    return bytes;
+}
+
+/* Add sizes around the number of nodes filling each data cache of CPU 0 */
+static void add_cache_sizes(long bytes)
+{
+    for (int i = 0 ; ; i++) {
+        char name[128], type[64], size[64];
+
+        snprintf(name, sizeof(name),
+                 "/sys/devices/system/cpu/cpu0/cache/index%d/type", i);
+        if (!read_line(name, type, sizeof(type)))
+            break;
+        snprintf(name, sizeof(name),
+                 "/sys/devices/system/cpu/cpu0/cache/index%d/size", i);
+        if (!strcmp(type, "Instruction") || !read_line(name, size, sizeof(size)))
+            continue;
+
+        char *unit;
+        long capacity = strtol(size, &unit, 10);
+        if (*unit == 'K')
+            capacity <<= 10;
+        else if (*unit == 'M')
+            capacity <<= 20;
+
+        double boundary = (double) capacity / bytes;
+        for (int k = -BOUNDARY_STEPS ; k <= BOUNDARY_STEPS ; k++) {
+            long num = lround(boundary * pow(2, (double) k / BOUNDARY_STEP));
+            if (num >= MIN_LEN && num <= MAX_LEN)
+                add_size(num);
         }
-        sort_id = 0;
     }
 }
 
+static void usage(const char *name)
+{
+    printf("Usage: %s [options] [single <n> | continuous]\n"
+           "  -e <engines>      engines to run, by name or index (all)\n"
+           "  -c <cases>        cases to run, by name or index (all)\n"
+           "  -n <n>[,<n>...]   explicit sizes, beyond %d with the `arena`\n"
+           "                    parameter of the driver\n"
+           "  -g <min>:<max>:<points>\n"
+           "                    sizes spaced evenly on the log scale\n"
+           "  -C                extra sizes around the capacities of the caches\n"
+           "  -b <bytes>        node size for -C (reported by the driver)\n"
+           "  -t <file>         run the trace case on the keys in the file, one\n"
+           "                    per line; the sizes default to its length\n"
+           "  -s <seed>         seed of the samples (0)\n"
+           "  -i <iteration>    only replay this iteration, printing its result\n"
+           "  -a                submit the iterations as jobs, which the driver\n"
+           "                    runs on its `job_cpu` while this waits elsewhere\n",
+           name, MAX_LEN);
+}
+
 int main(int argc, char *argv[])
 {
-    if (argc > 3) {
-        printf("Too much arguments\n");
-        return 1;
+    bool any_engine = false, any_case = false, cache_sizes = false;
+    bool async = false;
+    long bytes = 0, trace_len = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "e:c:n:g:Cb:t:s:i:ah")) != -1) {
+        switch (opt) {
+        case 'e':
+            select_names(optarg, engine_names, NR_ENGINES, engine_selected);
+            any_engine = true;
+            break;
+        case 'c':
+            select_names(optarg, case_names, NR_CASES, case_selected);
+            any_case = true;
+            break;
+        case 'n':
+            for (char *num = strtok(optarg, ",") ; num ; num = strtok(NULL, ","))
+                add_size(atol(num));
+            break;
+        case 'g': {
+            long min, max;
+            int points;
+            if (sscanf(optarg, "%ld:%ld:%d", &min, &max, &points) != 3 ||
+                min < MIN_LEN || max < min || points < 1) {
+                usage(argv[0]);
+                return 1;
+            }
+            add_log_sizes(min, max, points);
+            break;
+        }
+        case 'C':
+            cache_sizes = true;
+            break;
+        case 'b':
+            bytes = atol(optarg);
+            break;
+        case 't':
+            trace_len = load_trace(optarg);
+            if (trace_len < MIN_LEN) {
+                fprintf(stderr, "The trace has less than %d keys\n", MIN_LEN);
+                return 1;
+            }
+            case_selected[SORT_CASE_TRACE] = true;
+            any_case = true;
+            break;
+        case 's':
+            sample_seed = strtoull(optarg, NULL, 0);
+            break;
+        case 'i':
+            replay_iteration = atoi(optarg);
+            if (replay_iteration < 0 || replay_iteration >= LOOP) {
+                fprintf(stderr, "The iteration must be below %d\n", LOOP);
+                return 1;
+            }
+            break;
+        case 'a':
+            async = true;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
     }
 
-    if (!strcmp(argv[1], "continuous")) {
-        sort_test_continuously();
-    } else if (!strcmp(argv[1], "single")) {
-        if (argc < 3) {
+    if (optind < argc && !strcmp(argv[optind], "continuous")) {
+        for (int num = MIN_LEN ; num < CONTINUOUS_MAX ; num++)
+            add_size(num);
+    } else if (optind < argc && !strcmp(argv[optind], "single")) {
+        if (optind + 1 >= argc) {
             printf("Lack of given number for single node test\n");
             return 1;
         }
-        int num = atoi(argv[2]);
-        sort_test_one_num(num);
-    } else {
-        printf("Invalid argument %s\n", argv[1]);
+        add_size(atol(argv[optind + 1]));
+    } else if (optind < argc) {
+        printf("Invalid argument %s\n", argv[optind]);
+        return 1;
+    }
+    if (cache_sizes)
+        add_cache_sizes(bytes > 0 ? bytes : node_bytes());
+    if (!nr_sizes && trace_len)
+        add_size(trace_len);
+    if (!nr_sizes) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    /* the sizes in ascending order, each only once */
+    qsort(sizes, nr_sizes, sizeof(*sizes), size_cmp);
+    size_t nr = 0;
+    for (size_t i = 0 ; i < nr_sizes ; i++)
+        if (!nr || sizes[nr - 1] != sizes[i])
+            sizes[nr++] = sizes[i];
+    nr_sizes = nr;
+    if (sizes[nr_sizes - 1] > MAX_LEN && !arena_enabled()) {
+        fprintf(stderr, "The sizes beyond %d need the `arena` parameter of "
+                "the driver\n", MAX_LEN);
         return 1;
     }
+
+    /* a replay leaves the results file alone */
+    if (replay_iteration < 0) {
+        results = results_open(RESULTS_FILE);
+        if (!results) {
+            fprintf(stderr, "The results file `%s` might have been collapsed\n",
+                    RESULTS_FILE);
+            return 1;
+        }
+        run_output();
+        if (async)
+            open_jobs();
+    }
+
+    for (int case_id = 0 ; case_id < NR_CASES ; case_id++) {
+        if (any_case ? !case_selected[case_id] : case_id == SORT_CASE_TRACE)
+            continue;
+        for (int sort_id = 0 ; engine_names[sort_id] ; sort_id++) {
+            if (any_engine && !engine_selected[sort_id])
+                continue;
+            for (size_t i = 0 ; i < nr_sizes ; i++) {
+                /* the trace case sorts prefixes of the trace */
+                if (case_id == SORT_CASE_TRACE && sizes[i] > trace_len)
+                    break;
+                if (replay_iteration >= 0)
+                    sort_test_replay(sizes[i], case_id, sort_id);
+                else if (job_fd >= 0)
+                    sort_test_num_async(sizes[i], case_id, sort_id);
+                else
+                    sort_test_num(sizes[i], case_id, sort_id);
+            }
+        }
+    }
+
+    if (results)
+        fclose(results);
+    if (job_fd >= 0)
+        close(job_fd);
+    free(sizes);
     return 0;
 }
@@ -0,0 +1,203 @@
+/* Compare the durations of two sweeps of the client, e.g. before and after a
+ * change of an engine, and flag the significant speedups and regressions.
+ *
+ *   ./compare <base results> <new results> [threshold] [alpha]
+ *
+ * For each (engine, case, size) found in both sweeps, the histograms of the
+ * durations are tested with the Mann-Whitney U test. A difference is flagged if
+ * it is significant at `alpha` (0.001 by default, low enough to keep the false
+ * alarms of a whole sweep rare) and the medians differ by more than
+ * `threshold` (0.02 by default). The exit status is 1 if any regression is
+ * flagged.
+ */
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hist.h"
+#include "results.h"
+
+/* The offset of the record of each (engine, case, size) in a results file */
+struct record {
+    int engine, case_id;
+    uint64_t n;
+    long offset;
+};
+
+static int record_cmp(const void *a, const void *b)
+{
+    const struct record *ra = a, *rb = b;
+    if (ra->engine != rb->engine)
+        return ra->engine - rb->engine;
+    if (ra->case_id != rb->case_id)
+        return ra->case_id - rb->case_id;
+    return (ra->n > rb->n) - (ra->n < rb->n);
+}
+
+/* The records in the order they were written */
+static int record_order_cmp(const void *a, const void *b)
+{
+    const struct record *ra = a, *rb = b;
+    int res = record_cmp(a, b);
+    return res ? res : (ra->offset > rb->offset) - (ra->offset < rb->offset);
+}
+
+static int find_name(const char *const *names, int nr, const char *name)
+{
+    for (int i = 0; i < nr; i++)
+        if (!strcmp(names[i], name))
+            return i;
+    return -1;
+}
+
+/* Find the engine and the case of `rec`, returning false if either is
+ * unknown */
+static bool identify(const struct results_record *rec, int *engine,
+                     int *case_id)
+{
+    *engine = find_name(engine_names, NR_ENGINES, rec->engine);
+    *case_id = find_name(case_names, NR_CASES, rec->case_name);
+    return *engine >= 0 && *case_id >= 0;
+}
+
+/* Index the records of `file`; if a size is recorded more than once, its last
+ * record is used */
+static struct record *index_records(FILE *file, size_t *nr)
+{
+    struct results_run run;
+    struct results_record rec;
+    struct record *records = NULL;
+    size_t cap = 0;
+    long offset = ftell(file);
+
+    *nr = 0;
+    for (; results_next(file, &run, &rec, NULL); offset = ftell(file)) {
+        int engine, case_id;
+        if (!identify(&rec, &engine, &case_id))
+            continue;
+
+        if (*nr == cap) {
+            cap = cap ? cap * 2 : 4096;
+            records = realloc(records, cap * sizeof(*records));
+            if (!records) {
+                perror("Failed to index the records");
+                exit(EXIT_FAILURE);
+            }
+        }
+        records[(*nr)++] = (struct record){engine, case_id, rec.size, offset};
+    }
+
+    qsort(records, *nr, sizeof(*records), record_order_cmp);
+    size_t out = 0;
+    for (size_t i = 0; i < *nr; i++) {
+        if (out && !record_cmp(&records[out - 1], &records[i]))
+            out--;
+        records[out++] = records[i];
+    }
+    *nr = out;
+
+    return records;
+}
+
+/* The differences between two sweeps of one (engine, case) */
+struct comparison {
+    size_t sizes, faster, slower;
+    double log_ratio;
+};
+
+static struct comparison table[NR_ENGINES][NR_CASES];
+static struct hist base, cur;
+
+static void compare(FILE *base_file, FILE *new_file, double threshold,
+                    double alpha)
+{
+    size_t nr, new_nr;
+    struct record *records = index_records(base_file, &nr);
+    struct record *new_records = index_records(new_file, &new_nr);
+    struct results_run run;
+    struct results_record rec, base_rec;
+
+    for (size_t i = 0; i < new_nr; i++) {
+        struct record *key = &new_records[i];
+        struct record *found = bsearch(key, records, nr, sizeof(*records),
+                                       record_cmp);
+        if (!found)
+            continue;
+
+        fseek(base_file, found->offset, SEEK_SET);
+        fseek(new_file, key->offset, SEEK_SET);
+        if (!results_next(base_file, &run, &base_rec, &base) ||
+            !results_next(new_file, &run, &rec, &cur) || !base.total ||
+            !cur.total)
+            continue;
+
+        double z, p = hist_mann_whitney(&cur, &base, &z);
+        double ratio = (double) hist_percentile(&cur, 50) /
+                       fmax(1, hist_percentile(&base, 50));
+        struct comparison *res = &table[key->engine][key->case_id];
+
+        res->sizes++;
+        res->log_ratio += log(fmax(ratio, 1e-9));
+        if (p >= alpha || fabs(ratio - 1) <= threshold)
+            continue;
+
+        bool slower = z > 0;
+        if (slower)
+            res->slower++;
+        else
+            res->faster++;
+        printf("%-26s %-5s %8lu %10lu %10lu %+8.2f%% %10.3g %s\n", rec.engine,
+               rec.case_name, rec.size, hist_percentile(&base, 50),
+               hist_percentile(&cur, 50), (ratio - 1) * 100, p,
+               slower ? "REGRESSION" : "speedup");
+    }
+
+    free(records);
+    free(new_records);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3 || argc > 5) {
+        printf("Usage: %s <base results> <new results> [threshold] [alpha]\n",
+               argv[0]);
+        return 1;
+    }
+
+    double threshold = argc > 3 ? atof(argv[3]) : 0.02;
+    double alpha = argc > 4 ? atof(argv[4]) : 0.001;
+    FILE *base_file = results_open_read(argv[1]);
+    FILE *new_file = results_open_read(argv[2]);
+    if (!base_file || !new_file) {
+        fprintf(stderr, "%s isn't a results file\n",
+                base_file ? argv[2] : argv[1]);
+        return 1;
+    }
+
+    printf("%-26s %-5s %8s %10s %10s %9s %10s\n", "# engine", "case", "n",
+           "base_p50", "new_p50", "change", "p");
+    compare(base_file, new_file, threshold, alpha);
+    fclose(base_file);
+    fclose(new_file);
+
+    /* The summary of each (engine, case) with the geometric mean of the ratios
+     * of the medians */
+    bool regression = false;
+    printf("\n%-26s %-5s %8s %8s %8s %10s\n", "# engine", "case", "sizes",
+           "faster", "slower", "geomean");
+    for (int e = 0; e < NR_ENGINES; e++) {
+        for (int case_id = 0; case_id < NR_CASES; case_id++) {
+            struct comparison *c = &table[e][case_id];
+            if (!c->sizes)
+                continue;
+            printf("%-26s %-5s %8zu %8zu %8zu %+9.2f%%\n", engine_names[e],
+                   case_names[case_id], c->sizes, c->faster, c->slower,
+                   (exp(c->log_ratio / c->sizes) - 1) * 100);
+            regression |= c->slower;
+        }
+    }
+
+    return regression;
+}
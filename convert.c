@@ -0,0 +1,200 @@
+/* Convert the results file of the client into text
+ *
+ *   ./convert csv <results>
+ *       all the records as CSV, one row per (engine, case, size)
+ *   ./convert gnuplot <results> <column>
+ *       one column against the size, in a data block per (engine, case) for
+ *       the `index` of gnuplot; a comment on top of each block names it
+ */
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "results.h"
+
+static const char *const phase_names[] = SORT_PHASE_NAMES;
+
+/* The numeric columns of a record */
+static const struct column {
+    const char *name;
+    size_t offset;
+    bool integer;
+} columns[] = {
+#define U64_COLUMN(c) {#c, offsetof(struct results_record, c), true}
+#define DOUBLE_COLUMN(c) {#c, offsetof(struct results_record, c), false}
+    U64_COLUMN(time_p50),
+    U64_COLUMN(time_p90),
+    U64_COLUMN(time_p99),
+    U64_COLUMN(time_p999),
+    U64_COLUMN(time_max),
+    DOUBLE_COLUMN(time_mean),
+    DOUBLE_COLUMN(time_ci95),
+    DOUBLE_COLUMN(count_mean),
+    DOUBLE_COLUMN(count_ci95),
+    DOUBLE_COLUMN(k_mean),
+    DOUBLE_COLUMN(runs_mean),
+    DOUBLE_COLUMN(cmp_nh_mean),
+    DOUBLE_COLUMN(cost_nh_mean),
+    U64_COLUMN(gap_p50),
+    U64_COLUMN(gap_p99),
+    U64_COLUMN(gap_max),
+    DOUBLE_COLUMN(resched_mean),
+    DOUBLE_COLUMN(yield_mean),
+    DOUBLE_COLUMN(tlb_mean),
+#undef U64_COLUMN
+#undef DOUBLE_COLUMN
+};
+
+#define NR_COLUMNS ((int) (sizeof(columns) / sizeof(*columns)))
+
+static double column_value(const struct results_record *rec,
+                           const struct column *col)
+{
+    const char *field = (const char *) rec + col->offset;
+    return col->integer ? *(const uint64_t *) field : *(const double *) field;
+}
+
+static void print_csv(FILE *file)
+{
+    struct results_run run;
+    struct results_record rec;
+
+    memset(&run, 0, sizeof(run));
+    printf("engine,case,n,seed,cpu,cpus,kernel");
+    for (int c = 0; c < NR_COLUMNS; c++)
+        printf(",%s", columns[c].name);
+    for (int p = 0; p < SORT_PHASE_NR; p++)
+        printf(",cmps_%s,visits_%s,writes_%s", phase_names[p], phase_names[p],
+               phase_names[p]);
+    printf(",throughput\n");
+
+    while (results_next(file, &run, &rec, NULL)) {
+        printf("%s,%s,%lu,%lu,%u,%u,%s", rec.engine, rec.case_name, rec.size,
+               rec.seed, rec.cpu, rec.cpus, run.kernel);
+        for (int c = 0; c < NR_COLUMNS; c++)
+            printf(",%.10g", column_value(&rec, &columns[c]));
+        for (int p = 0; p < SORT_PHASE_NR; p++)
+            printf(",%f,%f,%f", rec.phase_cmps[p], rec.phase_visits[p],
+                   rec.phase_writes[p]);
+        /* the nodes sorted per second by all the CPUs, at the median duration
+         * of the slowest one */
+        printf(",%.10g\n", (double) rec.cpus * rec.size * 1e9 /
+                                fmax(rec.time_p50, 1));
+    }
+}
+
+/* One point of the gnuplot output */
+struct point {
+    int engine, case_id;
+    uint64_t n;
+    size_t order; /* the position of the record in the file */
+    double value;
+};
+
+static bool same_block(const struct point *a, const struct point *b)
+{
+    return a->engine == b->engine && a->case_id == b->case_id;
+}
+
+static int point_cmp(const void *a, const void *b)
+{
+    const struct point *pa = a, *pb = b;
+    if (pa->engine != pb->engine)
+        return pa->engine - pb->engine;
+    if (pa->case_id != pb->case_id)
+        return pa->case_id - pb->case_id;
+    if (pa->n != pb->n)
+        return pa->n > pb->n ? 1 : -1;
+    return (pa->order > pb->order) - (pa->order < pb->order);
+}
+
+static int find_name(const char *const *names, int nr, const char *name)
+{
+    for (int i = 0; i < nr; i++)
+        if (!strcmp(names[i], name))
+            return i;
+    return -1;
+}
+
+static int print_gnuplot(FILE *file, const char *name)
+{
+    const struct column *col = NULL;
+    for (int c = 0; c < NR_COLUMNS; c++)
+        if (!strcmp(columns[c].name, name))
+            col = &columns[c];
+    if (!col) {
+        fprintf(stderr, "Unknown column %s\n", name);
+        return 1;
+    }
+
+    struct results_run run;
+    struct results_record rec;
+    struct point *points = NULL;
+    size_t nr = 0, cap = 0;
+
+    while (results_next(file, &run, &rec, NULL)) {
+        int engine = find_name(engine_names, NR_ENGINES, rec.engine);
+        int case_id = find_name(case_names, NR_CASES, rec.case_name);
+        if (engine < 0 || case_id < 0)
+            continue;
+
+        if (nr == cap) {
+            cap = cap ? cap * 2 : 4096;
+            points = realloc(points, cap * sizeof(*points));
+            if (!points) {
+                perror("Failed to load the records");
+                exit(EXIT_FAILURE);
+            }
+        }
+        points[nr] = (struct point){engine, case_id, rec.size, nr,
+                                    column_value(&rec, col)};
+        nr++;
+    }
+    qsort(points, nr, sizeof(*points), point_cmp);
+
+    int index = 0;
+    for (size_t i = 0; i < nr; i++) {
+        if (!i || !same_block(&points[i - 1], &points[i]))
+            printf("%s# index %d: %s %s\n# n %s\n", i ? "\n\n" : "",
+                   index++, engine_names[points[i].engine],
+                   case_names[points[i].case_id], name);
+        /* the last record of a size wins */
+        if (i + 1 < nr && same_block(&points[i], &points[i + 1]) &&
+            points[i].n == points[i + 1].n)
+            continue;
+        printf("%lu %.10g\n", points[i].n, points[i].value);
+    }
+
+    free(points);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3 || (!strcmp(argv[1], "gnuplot") && argc < 4)) {
+        printf("Usage: %s csv <results>\n"
+               "       %s gnuplot <results> <column>\n", argv[0], argv[0]);
+        return 1;
+    }
+
+    FILE *file = results_open_read(argv[2]);
+    if (!file) {
+        fprintf(stderr, "%s isn't a results file\n", argv[2]);
+        return 1;
+    }
+
+    int res = 0;
+    if (!strcmp(argv[1], "csv")) {
+        print_csv(file);
+    } else if (!strcmp(argv[1], "gnuplot")) {
+        res = print_gnuplot(file, argv[3]);
+    } else {
+        printf("Invalid argument %s\n", argv[1]);
+        res = 1;
+    }
+
+    fclose(file);
+    return res;
+}
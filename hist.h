@@ -0,0 +1,141 @@
+/* The streaming statistics of the user space tools: a log-linear (HDR style)
+ * histogram for the latencies, and the running moments for the means with
+ * their confidence intervals.
+ */
+#ifndef HIST_H
+#define HIST_H
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Values below `HIST_SUB` are recorded exactly; larger ones keep their top
+ * `HIST_SUB_BITS` bits, which bounds the relative error to 1 / 64 */
+#define HIST_SUB_BITS 7
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_HALF (HIST_SUB >> 1)
+#define HIST_BUCKETS (HIST_SUB + (64 - HIST_SUB_BITS) * HIST_HALF)
+
+struct hist {
+    uint64_t total, max;
+    uint32_t counts[HIST_BUCKETS];
+};
+
+/* Welford's running mean and variance */
+struct moments {
+    uint64_t n;
+    double mean, m2;
+};
+
+static inline unsigned int hist_index(uint64_t v)
+{
+    if (v < HIST_SUB)
+        return v;
+
+    /* `v >> shift` lands in [HIST_HALF, HIST_SUB) */
+    int shift = 63 - __builtin_clzll(v) - (HIST_SUB_BITS - 1);
+    return HIST_SUB + (shift - 1) * HIST_HALF + (v >> shift) - HIST_HALF;
+}
+
+/* The middle of the values recorded into the bucket `idx` */
+static inline uint64_t hist_value(unsigned int idx)
+{
+    if (idx < HIST_SUB)
+        return idx;
+
+    int shift = (idx - HIST_SUB) / HIST_HALF + 1;
+    uint64_t m = (idx - HIST_SUB) % HIST_HALF + HIST_HALF;
+    return (m << shift) + ((1ULL << shift) >> 1);
+}
+
+static inline void hist_reset(struct hist *h)
+{
+    memset(h, 0, sizeof(*h));
+}
+
+static inline void hist_record(struct hist *h, uint64_t v)
+{
+    h->counts[hist_index(v)]++;
+    h->total++;
+    if (v > h->max)
+        h->max = v;
+}
+
+/* The value at the percentile `p` in [0, 100] */
+static inline uint64_t hist_percentile(const struct hist *h, double p)
+{
+    uint64_t rank = (uint64_t) ceil(p / 100 * h->total), seen = 0;
+    if (!rank)
+        rank = 1;
+
+    for (unsigned int i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->counts[i];
+        if (seen >= rank)
+            return hist_value(i) < h->max ? hist_value(i) : h->max;
+    }
+    return h->max;
+}
+
+/* The two-sided Mann-Whitney U test of the samples of `a` against those of
+ * `b`, where the samples in a bucket are ties. Returns the p-value, and the
+ * normal approximation `z` of U which is positive if the samples of `a` tend
+ * to be larger. */
+static inline double hist_mann_whitney(const struct hist *a,
+                                       const struct hist *b,
+                                       double *z)
+{
+    double n1 = a->total, n2 = b->total, n = n1 + n2;
+    double u = 0, ties = 0, below = 0;
+
+    *z = 0;
+    if (!a->total || !b->total)
+        return 1;
+
+    for (unsigned int i = 0; i < HIST_BUCKETS; i++) {
+        double t = (double) a->counts[i] + b->counts[i];
+        /* the samples of `b` below a sample of `a`, counting the ties half */
+        u += a->counts[i] * (below + b->counts[i] / 2.0);
+        below += b->counts[i];
+        ties += t * t * t - t;
+    }
+
+    double var = n1 * n2 / 12 * ((n + 1) - ties / (n * (n - 1)));
+    if (var <= 0)
+        return 1;
+
+    double diff = u - n1 * n2 / 2;
+    /* the continuity correction */
+    diff -= copysign(fmin(0.5, fabs(diff)), diff);
+    *z = diff / sqrt(var);
+    return erfc(fabs(*z) / sqrt(2));
+}
+
+static inline void moments_reset(struct moments *m)
+{
+    memset(m, 0, sizeof(*m));
+}
+
+/* NaN samples (e.g. undefined ratios) are skipped */
+static inline void moments_add(struct moments *m, double x)
+{
+    if (isnan(x))
+        return;
+
+    double delta = x - m->mean;
+    m->n++;
+    m->mean += delta / m->n;
+    m->m2 += delta * (x - m->mean);
+}
+
+static inline double moments_sd(const struct moments *m)
+{
+    return m->n > 1 ? sqrt(m->m2 / (m->n - 1)) : 0;
+}
+
+/* The half width of the 95% confidence interval of the mean */
+static inline double moments_ci95(const struct moments *m)
+{
+    return m->n ? 1.96 * moments_sd(m) / sqrt(m->n) : 0;
+}
+
+#endif
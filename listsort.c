@@ -19,12 +19,14 @@ static struct list_head *merge(void *priv, list_cmp_func_t cmp,
 {
 	struct list_head *head, **tail = &head;
 
+	sort_stat_phase(SORT_PHASE_MERGE);
 	for (;;) {
 		/* if equal, take 'a' -- important for sort stability */
 		if (cmp(priv, a, b) <= 0) {
 			*tail = a;
 			tail = &a->next;
 			a = a->next;
+			sort_stat_work(1, 1);
 			if (!a) {
 				*tail = b;
 				break;
@@ -33,6 +35,7 @@ static struct list_head *merge(void *priv, list_cmp_func_t cmp,
 			*tail = b;
 			tail = &b->next;
 			b = b->next;
+			sort_stat_work(1, 1);
 			if (!b) {
 				*tail = a;
 				break;
@@ -56,6 +59,7 @@ static void merge_final(void *priv, list_cmp_func_t cmp, struct list_head *head,
 	struct list_head *tail = head;
 	u8 count = 0;
 
+	sort_stat_phase(SORT_PHASE_MERGE_FINAL);
 	for (;;) {
 		/* if equal, take 'a' -- important for sort stability */
 		if (cmp(priv, a, b) <= 0) {
@@ -63,6 +67,7 @@ static void merge_final(void *priv, list_cmp_func_t cmp, struct list_head *head,
 			a->prev = tail;
 			tail = a;
 			a = a->next;
+			sort_stat_work(1, 2);
 			if (!a)
 				break;
 		} else {
@@ -70,6 +75,7 @@ static void merge_final(void *priv, list_cmp_func_t cmp, struct list_head *head,
 			b->prev = tail;
 			tail = b;
 			b = b->next;
+			sort_stat_work(1, 2);
 			if (!b) {
 				b = a;
 				break;
@@ -92,6 +98,7 @@ static void merge_final(void *priv, list_cmp_func_t cmp, struct list_head *head,
 		b->prev = tail;
 		tail = b;
 		b = b->next;
+		sort_stat_work(1, 1);
 	} while (b);
 
 	/* And the final links to make a circular doubly-linked list */
@@ -99,6 +106,36 @@ static void merge_final(void *priv, list_cmp_func_t cmp, struct list_head *head,
 	head->prev = tail;
 }
 
+/*
+ * The merge cost of the final merges of list_sort(), i.e. the sum of their
+ * lengths, derived from @count alone: following the states described in
+ * list_sort(), the pending sublists of size 2^k number bit k-1 of @count
+ * if bit k is set, else one plus bit k-1 if the higher bits are non-zero,
+ * and they are merged from the smallest to the largest.
+ */
+static u64 final_merge_cost(size_t count)
+{
+	u64 cost = 0;
+	size_t merged = 0;
+
+	for (unsigned int k = 0; count >> k; k++) {
+		size_t lower = k ? (count >> (k - 1)) & 1 : 1;
+		size_t pending;
+
+		if ((count >> k) & 1)
+			pending = lower;
+		else
+			pending = (count >> (k + 1)) ? 1 + lower : 0;
+
+		for (; pending; pending--) {
+			if (merged)
+				cost += merged + ((size_t)1 << k);
+			merged += (size_t)1 << k;
+		}
+	}
+	return cost;
+}
+
 /**
  * list_sort - sort a list
  * @priv: private data, opaque to list_sort(), passed to @cmp
@@ -192,6 +229,7 @@ void list_sort(void *priv, struct list_head *head, list_cmp_func_t cmp)
 
 	/* Convert to a null-terminated singly-linked list. */
 	head->prev->next = NULL;
+	sort_stat_phase(SORT_PHASE_RUN_DETECT);
 
 	/*
 	 * Data structure invariants:
@@ -223,9 +261,12 @@ void list_sort(void *priv, struct list_head *head, list_cmp_func_t cmp)
 			struct list_head *a = *tail, *b = a->prev;
 
 			a = merge(priv, cmp, b, a);
+			/* Two sublists of 2^k, k being the trailing ones of count */
+			sort_stat_cost((count ^ (count + 1)) + 1);
 			/* Install the merged result in place of the inputs */
 			a->prev = b->prev;
 			*tail = a;
+			sort_stat_phase(SORT_PHASE_RUN_DETECT);
 		}
 
 		/* Move one element from input list to pending */
@@ -234,9 +275,11 @@ void list_sort(void *priv, struct list_head *head, list_cmp_func_t cmp)
 		list = list->next;
 		pending->next = NULL;
 		count++;
+		sort_stat_work(1, 2);
 	} while (list);
 
 	/* End of input; merge together all the pending lists. */
+	sort_stat_cost(final_merge_cost(count));
 	list = pending;
 	pending = pending->prev;
 	for (;;) {
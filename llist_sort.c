@@ -0,0 +1,132 @@
+// SPDX-License-Identifier: GPL-2.0
+#include <linux/kernel.h>
+#include <linux/bug.h>
+#include <linux/compiler.h>
+#include <linux/export.h>
+#include <linux/llist.h>
+#include <linux/string.h>
+
+#include "sort.h"
+
+/*
+ * list_sort() of singly linked lists: the pending sublists are kept in an
+ * on-stack array instead of being chained by their prev links, and the final
+ * merge is a plain merge() as there are no prev links to rebuild.
+ */
+
+/* The pending sublists, at most two of each power of two below 2^64 */
+#define MAX_PENDING (2 * BITS_PER_LONG)
+
+__attribute__((nonnull(2,3,4)))
+static struct llist_node *merge(void *priv, llist_cmp_func_t cmp,
+				struct llist_node *a, struct llist_node *b)
+{
+	struct llist_node *head, **tail = &head;
+
+	for (;;) {
+		/* if equal, take 'a' -- important for sort stability */
+		if (cmp(priv, a, b) <= 0) {
+			*tail = a;
+			tail = &a->next;
+			a = a->next;
+			sort_stat_work(1, 1);
+			if (!a) {
+				*tail = b;
+				break;
+			}
+		} else {
+			*tail = b;
+			tail = &b->next;
+			b = b->next;
+			sort_stat_work(1, 1);
+			if (!b) {
+				*tail = a;
+				break;
+			}
+		}
+	}
+	return head;
+}
+
+/* See final_merge_cost() of listsort.c */
+static u64 final_merge_cost(size_t count)
+{
+	u64 cost = 0;
+	size_t merged = 0;
+
+	for (unsigned int k = 0; count >> k; k++) {
+		size_t lower = k ? (count >> (k - 1)) & 1 : 1;
+		size_t pending;
+
+		if ((count >> k) & 1)
+			pending = lower;
+		else
+			pending = (count >> (k + 1)) ? 1 + lower : 0;
+
+		for (; pending; pending--) {
+			if (merged)
+				cost += merged + ((size_t)1 << k);
+			merged += (size_t)1 << k;
+		}
+	}
+	return cost;
+}
+
+/**
+ * llist_sort - sort a singly linked list
+ * @priv: private data, opaque to llist_sort(), passed to @cmp
+ * @list: the first node of the null-terminated list, e.g. from
+ *	  llist_del_all()
+ * @cmp: the elements comparison function, as for list_sort()
+ *
+ * Returns the first node of the sorted list. The merges are those of
+ * list_sort(), so the sort is stable and takes the same comparisons.
+ */
+struct llist_node *llist_sort(void *priv, struct llist_node *list,
+			      llist_cmp_func_t cmp)
+{
+	struct llist_node *pending[MAX_PENDING];
+	size_t count = 0, nr = 0;	/* Count of pending nodes, and sublists */
+
+	if (!list || !list->next)	/* Zero or one elements */
+		return list;
+
+	sort_stat_phase(SORT_PHASE_RUN_DETECT);
+	do {
+		size_t bits, at = nr;
+
+		/* Find the least-significant clear bit in count, the sublists
+		 * newer than the ones to merge being one per trailing one */
+		for (bits = count; bits & 1; bits >>= 1)
+			at--;
+		/* Merge the sublists below them, the older first */
+		if (likely(bits)) {
+			sort_stat_phase(SORT_PHASE_MERGE);
+			pending[at - 2] = merge(priv, cmp, pending[at - 2],
+						pending[at - 1]);
+			sort_stat_cost((count ^ (count + 1)) + 1);
+			memmove(&pending[at - 1], &pending[at],
+				(nr - at) * sizeof(*pending));
+			nr--;
+			sort_stat_phase(SORT_PHASE_RUN_DETECT);
+		}
+
+		/* Move one element from input list to pending */
+		pending[nr++] = list;
+		list = list->next;
+		pending[nr - 1]->next = NULL;
+		count++;
+		sort_stat_work(1, 1);
+	} while (list);
+
+	/* End of input; merge together all the pending lists, the final
+	 * merge being like the others */
+	sort_stat_cost(final_merge_cost(count));
+	list = pending[--nr];
+	while (nr) {
+		sort_stat_phase(nr == 1 ? SORT_PHASE_MERGE_FINAL
+					: SORT_PHASE_MERGE);
+		list = merge(priv, cmp, pending[--nr], list);
+	}
+	return list;
+}
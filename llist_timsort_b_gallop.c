@@ -0,0 +1,396 @@
+#include <linux/kernel.h>
+#include <linux/bug.h>
+#include <linux/compiler.h>
+#include <linux/export.h>
+#include <linux/llist.h>
+#include <linux/string.h>
+
+#include "sort.h"
+#include "sort_trace.h"
+
+/* timsort_b_gallop() of singly linked lists. The run stack is an on-stack
+ * array of the runs and their lengths instead of being chained by the prev
+ * links of the runs, and the final merge is like the others.
+ *
+ * The galloping mode always passes the node of the earlier run as the first
+ * argument of cmp(), and lets it win the ties, so that the sort is stable
+ * even with the comparators returning a boolean.
+ */
+
+#define MIN_GALLOP 7
+
+/* The runs of the stack, which the merge policy keeps growing faster than
+ * the Fibonacci numbers from the top down, so 85 runs are enough below 2^64
+ * nodes */
+#define MAX_RUNS 85
+
+struct run {
+    struct llist_node *head;
+    size_t len;
+};
+
+/* Whether `node` of the run `list` goes before `key`, which is the head of
+ * the run after it if `earlier`, or before it otherwise */
+static inline bool goes_before(void *priv,
+                               llist_cmp_func_t cmp,
+                               struct llist_node *node,
+                               struct llist_node *key,
+                               bool earlier)
+{
+    return earlier ? cmp(priv, node, key) <= 0 : cmp(priv, key, node) > 0;
+}
+
+/* Move the nodes at the start of `*list` which go before `key` to `**tail`
+ * with an exponential search followed by a binary search, then `key` itself,
+ * which is known to go next. Returns the number of nodes moved from
+ * `*list`. */
+static size_t gallop(void *priv,
+                     llist_cmp_func_t cmp,
+                     struct llist_node **list,
+                     struct llist_node *key,
+                     bool earlier,
+                     struct llist_node ***tail,
+                     u8 *count)
+{
+    struct llist_node *last = NULL, *probe = *list;
+    size_t moved = 0, gap = 0, step = 1;
+
+    /* Find a node which doesn't go before `key`, `last` being the last one
+     * known to go before it and `gap` the nodes between them */
+    sort_stat_phase(SORT_PHASE_GALLOP_SEARCH);
+    while (goes_before(priv, cmp, probe, key, earlier)) {
+        last = probe;
+        moved += gap + 1;
+        for (gap = 0; gap < step && probe->next; gap++) {
+            /* the steps grow with the run, call back while walking them */
+            if (unlikely(!++*count))
+                cmp(priv, probe, probe);
+            probe = probe->next;
+            sort_stat_work(1, 0);
+        }
+        if (probe == last) {
+            /* the whole run goes before `key` */
+            gap = 0;
+            break;
+        }
+        gap--;
+        step <<= 1;
+    }
+
+    /* The binary search of the gap, walking to the middle node each time */
+    while (gap) {
+        size_t half = gap >> 1;
+        struct llist_node *middle = last ? last->next : *list;
+
+        for (size_t i = 0; i < half; i++) {
+            if (unlikely(!++*count))
+                cmp(priv, middle, middle);
+            middle = middle->next;
+            sort_stat_work(1, 0);
+        }
+        if (goes_before(priv, cmp, middle, key, earlier)) {
+            last = middle;
+            moved += half + 1;
+            gap -= half + 1;
+        } else {
+            gap = half;
+        }
+    }
+
+    sort_stat_phase(SORT_PHASE_GALLOP_INSERT);
+    if (last) {
+        **tail = *list;
+        *tail = &last->next;
+        *list = last->next;
+        sort_stat_work(0, 1);
+    }
+    if (*list) {
+        **tail = key;
+        *tail = &key->next;
+        sort_stat_work(0, 1);
+    }
+    return moved;
+}
+
+static struct llist_node *merge(void *priv,
+                                llist_cmp_func_t cmp,
+                                struct llist_node *a,
+                                struct llist_node *b,
+                                size_t *gallop_entries)
+{
+    struct llist_node *head = NULL;
+    struct llist_node **tail = &head;
+    u8 count = 0;
+    int wins_a = 0, wins_b = 0;
+    int min_gallop = MIN_GALLOP;
+    /* of this merge, which the galloping mode returns to */
+    unsigned int phase = sort_phase;
+
+    for (;;) {
+        /* if equal, take 'a' -- important for sort stability */
+        if (cmp(priv, a, b) <= 0) {
+            *tail = a;
+            tail = &a->next;
+            a = a->next;
+            sort_stat_work(1, 1);
+            wins_a++;
+            wins_b = 0;
+            if (!a)
+                break;
+        } else {
+            *tail = b;
+            tail = &b->next;
+            b = b->next;
+            sort_stat_work(1, 1);
+            wins_b++;
+            wins_a = 0;
+            if (!b)
+                break;
+        }
+        if (wins_a < min_gallop && wins_b < min_gallop)
+            continue;
+
+        /* Galloping mode: move the nodes of each run going before the head
+         * of the other in turn, for as long as the moves are long */
+        (*gallop_entries)++;
+        size_t moved_a, moved_b;
+        do {
+            moved_a = gallop(priv, cmp, &a, b, true, &tail, &count);
+            if (!a)
+                goto out;
+            b = b->next;
+            if (!b)
+                goto out;
+            moved_b = gallop(priv, cmp, &b, a, false, &tail, &count);
+            if (!b)
+                goto out;
+            a = a->next;
+            if (!a)
+                goto out;
+            if (min_gallop > 1)
+                min_gallop--;
+        } while (moved_a >= MIN_GALLOP || moved_b >= MIN_GALLOP);
+        /* leaving the galloping mode costs it some favour */
+        min_gallop += 2;
+        wins_a = wins_b = 0;
+        sort_stat_phase(phase);
+    }
+
+out:
+    *tail = a ? a : b;
+    return head;
+}
+
+/* The binary insertion sort to extend the run started from `head` to the
+ * length of `minrun`, in an on-stack array as in timsort_b_gallop() */
+static struct llist_node *binary_insertion(void *priv,
+                                           llist_cmp_func_t cmp,
+                                           struct llist_node *head,
+                                           struct llist_node **next,
+                                           size_t *len,
+                                           size_t minrun)
+{
+    struct llist_node *run[MAX_MINRUN];
+    struct llist_node *in_node = *next;
+    size_t n = 0;
+
+    sort_stat_phase(SORT_PHASE_INSERTION);
+    for (struct llist_node *curr = head; curr; curr = curr->next)
+        run[n++] = curr;
+    sort_stat_work(n, 0);
+
+    for (; in_node && n < minrun; in_node = in_node->next) {
+        size_t left = 0, right = n;
+
+        /* search for the slot after the last node which is not larger than
+         * `in_node` -- important for sort stability */
+        while (left < right) {
+            size_t middle = (left + right) >> 1;
+            if (cmp(priv, run[middle], in_node) <= 0)
+                left = middle + 1;
+            else
+                right = middle;
+        }
+
+        memmove(&run[left + 1], &run[left], (n - left) * sizeof(*run));
+        run[left] = in_node;
+        n++;
+        sort_stat_work(1, 0);
+    }
+
+    /* Relink the nodes in the order of the array */
+    for (size_t i = 1; i < n; i++)
+        run[i - 1]->next = run[i];
+    run[n - 1]->next = NULL;
+    sort_stat_work(0, n);
+
+    *next = in_node;
+    *len = n;
+    return run[0];
+}
+
+/* Cut the run starting at `*list` off the input, returning it */
+static struct run find_run(void *priv,
+                           struct llist_node **list,
+                           llist_cmp_func_t cmp,
+                           size_t minrun)
+{
+    struct llist_node *node = *list, *next = node->next, *head = node;
+    size_t len = 1;
+    bool descending = false;
+
+    if (!next) {
+        trace_sort_run_found(1, false, 1);
+        *list = NULL;
+        return (struct run){head, 1};
+    }
+
+    sort_stat_phase(SORT_PHASE_RUN_DETECT);
+    if (cmp(priv, node, next) > 0) {
+        /* decending run, also reverse the list */
+        struct llist_node *prev = NULL;
+        descending = true;
+        sort_stat_phase(SORT_PHASE_RUN_REVERSE);
+        do {
+            len++;
+            node->next = prev;
+            prev = node;
+            node = next;
+            next = node->next;
+            head = node;
+            sort_stat_work(1, 1);
+        } while (next && cmp(priv, node, next) > 0);
+        node->next = prev;
+    } else {
+        do {
+            len++;
+            node = next;
+            next = node->next;
+            sort_stat_work(1, 0);
+        } while (next && cmp(priv, node, next) <= 0);
+        node->next = NULL;
+    }
+    size_t natural = len;
+
+    if (len < minrun)
+        head = binary_insertion(priv, cmp, head, &next, &len, minrun);
+
+    trace_sort_run_found(natural, descending, len);
+    *list = next;
+    return (struct run){head, len};
+}
+
+/* Merge the runs `at` and `at + 1` of the stack */
+static void merge_at(void *priv,
+                     llist_cmp_func_t cmp,
+                     struct run *stack,
+                     size_t at,
+                     size_t *stk_size)
+{
+    size_t len = stack[at].len + stack[at + 1].len;
+    /* the times galloping mode is entered in this merge */
+    size_t gallop_entries = 0;
+
+    sort_stat_cost(len);
+    sort_stat_phase(SORT_PHASE_MERGE);
+    stack[at].head = merge(priv, cmp, stack[at].head, stack[at + 1].head,
+                           &gallop_entries);
+    trace_sort_merge_at(stack[at].len, stack[at + 1].len, *stk_size,
+                        gallop_entries);
+    stack[at].len = len;
+    memmove(&stack[at + 1], &stack[at + 2],
+            (*stk_size - at - 2) * sizeof(*stack));
+    --*stk_size;
+}
+
+static void merge_force_collapse(void *priv,
+                                 llist_cmp_func_t cmp,
+                                 struct run *stack,
+                                 size_t *stk_size)
+{
+    size_t n;
+
+    while ((n = *stk_size) >= 3) {
+        if (stack[n - 3].len < stack[n - 1].len)
+            merge_at(priv, cmp, stack, n - 3, stk_size);
+        else
+            merge_at(priv, cmp, stack, n - 2, stk_size);
+    }
+}
+
+static void merge_collapse(void *priv,
+                           llist_cmp_func_t cmp,
+                           struct run *stack,
+                           size_t *stk_size)
+{
+    size_t n;
+
+    while ((n = *stk_size) >= 2) {
+        if ((n >= 3 &&
+             stack[n - 3].len <= stack[n - 2].len + stack[n - 1].len) ||
+            (n >= 4 &&
+             stack[n - 4].len <= stack[n - 3].len + stack[n - 2].len)) {
+            if (stack[n - 3].len < stack[n - 1].len)
+                merge_at(priv, cmp, stack, n - 3, stk_size);
+            else
+                merge_at(priv, cmp, stack, n - 2, stk_size);
+        } else if (stack[n - 2].len <= stack[n - 1].len) {
+            merge_at(priv, cmp, stack, n - 2, stk_size);
+        } else {
+            break;
+        }
+    }
+}
+
+static int find_minrun(size_t size)
+{
+    int one = 0;
+
+    /* To get the first five bits (MAX_minrun_b = 32) */
+    while (size > 0x001F) {
+        one = (size & 0x01) ? 1 : one; /* holding carry */
+        size >>= 1;
+    }
+
+    return size + one;
+}
+
+/* Sort the null-terminated list starting at `list`, e.g. from
+ * llist_del_all(), returning its first node */
+struct llist_node *llist_timsort_b_gallop(void *priv,
+                                          struct llist_node *list,
+                                          llist_cmp_func_t cmp)
+{
+    struct run stack[MAX_RUNS];
+    size_t stk_size = 0, nodes = 0;
+
+    if (!list || !list->next)
+        return list;
+
+    /* the walk takes no comparison; call back every 256 nodes anyway so that
+     * cmp() can cond_resched() */
+    for (struct llist_node *node = list; node; node = node->next)
+        if (unlikely(!(++nodes & 0xff)))
+            cmp(priv, node, node);
+    size_t minrun = find_minrun(nodes);
+
+    do {
+        stack[stk_size++] = find_run(priv, &list, cmp, minrun);
+        merge_collapse(priv, cmp, stack, &stk_size);
+    } while (list);
+
+    /* End of input; merge together all the runs. */
+    merge_force_collapse(priv, cmp, stack, &stk_size);
+    if (stk_size <= 1) {
+        trace_sort_merge_final(stack[0].len, 0);
+        return stack[0].head;
+    }
+
+    size_t gallop_entries = 0;
+
+    trace_sort_merge_final(stack[0].len, stack[1].len);
+    sort_stat_cost(stack[0].len + stack[1].len);
+    sort_stat_phase(SORT_PHASE_MERGE_FINAL);
+    list = merge(priv, cmp, stack[0].head, stack[1].head, &gallop_entries);
+    return list;
+}
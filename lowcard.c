@@ -0,0 +1,162 @@
+#include <linux/kernel.h>
+#include <linux/bug.h>
+#include <linux/compiler.h>
+#include <linux/export.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/string.h>
+#include <linux/list.h>
+
+#include "sort.h"
+
+/* The number of leading nodes sampled to detect a low-cardinality input, and
+ * the most distinct keys the sample may hold */
+#define LOWCARD_SAMPLE 64
+#define LOWCARD_SAMPLE_KEYS 8
+/* The most distinct keys the bucketing pass handles before giving up */
+#define LOWCARD_MAX_KEYS 16
+
+/* The parameter, which the test driver latches into `lowcard_fallback` when a
+ * test starts */
+bool lowcard_param;
+module_param_named(lowcard_fallback, lowcard_param, bool, 0644);
+MODULE_PARM_DESC(lowcard_fallback,
+                 "Let the adaptive engines bucket low-cardinality inputs");
+
+/* Whether the adaptive engines try the fallback in the running test */
+bool lowcard_fallback;
+
+struct bucket {
+    struct list_head *head, *tail;
+};
+
+/* Binary search on the keys of the buckets, which are kept in ascending order.
+ *
+ * Returns the index of the bucket whose key equals to `node`, or the index to
+ * insert a new bucket for `node` with `*found` cleared.
+ */
+static size_t find_bucket(void *priv,
+                          list_cmp_func_t cmp,
+                          struct bucket *buckets,
+                          size_t nr,
+                          struct list_head *node,
+                          bool *found)
+{
+    size_t left = 0, right = nr;
+
+    /* the first bucket whose key is larger than `node` */
+    while (left < right) {
+        size_t middle = (left + right) >> 1;
+        if (cmp(priv, buckets[middle].head, node) <= 0)
+            left = middle + 1;
+        else
+            right = middle;
+    }
+
+    /* the key before it is not larger than `node`, so both are equal when
+     * `node` isn't larger than that key either */
+    *found = left && cmp(priv, node, buckets[left - 1].head) <= 0;
+    return *found ? left - 1 : left;
+}
+
+/* Check if the first `LOWCARD_SAMPLE` nodes hold no more than
+ * `LOWCARD_SAMPLE_KEYS` distinct keys. The list isn't modified. */
+static bool sample_lowcard(void *priv,
+                           list_cmp_func_t cmp,
+                           struct list_head *head)
+{
+    struct bucket keys[LOWCARD_SAMPLE_KEYS];
+    struct list_head *node = head->next;
+    size_t nr = 0;
+
+    for (int i = 0; i < LOWCARD_SAMPLE; i++, node = node->next) {
+        bool found;
+
+        /* too short to be worth bucketing */
+        if (node == head)
+            return false;
+
+        size_t pos = find_bucket(priv, cmp, keys, nr, node, &found);
+        sort_stat_work(1, 0);
+        if (found)
+            continue;
+        if (nr == LOWCARD_SAMPLE_KEYS)
+            return false;
+
+        memmove(&keys[pos + 1], &keys[pos], (nr - pos) * sizeof(*keys));
+        keys[pos].head = node;
+        nr++;
+    }
+
+    return true;
+}
+
+/**
+ * lowcard_sort_try - sort a list with only a few distinct keys
+ * @priv: private data, passed to @cmp
+ * @head: the list to sort
+ * @cmp: the elements comparison function
+ *
+ * Descending runs end at the first equal pair, so inputs drawn from a few
+ * distinct keys are chopped into many tiny runs by find_run(). Instead, this
+ * function moves every node to the tail of the sub-list of its key in a single
+ * pass, which keeps the equal nodes in their original order, and splices the
+ * sub-lists in key order.
+ *
+ * Returns true if the list is sorted. Otherwise the list is either untouched
+ * (the sample shows too many keys), or starts with the bucketed prefix followed
+ * by the remaining nodes in their original order (more than `LOWCARD_MAX_KEYS`
+ * keys met), and still has to be sorted by a stable engine.
+ */
+bool lowcard_sort_try(void *priv, struct list_head *head, list_cmp_func_t cmp)
+{
+    struct bucket buckets[LOWCARD_MAX_KEYS];
+    struct list_head *node, *safe;
+    size_t nr = 0;
+
+    sort_stat_phase(SORT_PHASE_BUCKET);
+    if (!sample_lowcard(priv, cmp, head))
+        return false;
+
+    for (node = head->next; node != head; node = safe) {
+        bool found;
+        size_t pos = find_bucket(priv, cmp, buckets, nr, node, &found);
+
+        if (!found && nr == LOWCARD_MAX_KEYS)
+            break;
+
+        safe = node->next;
+        if (found) {
+            buckets[pos].tail->next = node;
+            node->prev = buckets[pos].tail;
+            buckets[pos].tail = node;
+        } else {
+            memmove(&buckets[pos + 1], &buckets[pos],
+                    (nr - pos) * sizeof(*buckets));
+            buckets[pos].head = buckets[pos].tail = node;
+            nr++;
+        }
+        sort_stat_work(1, 2);
+    }
+
+    /* Splice the buckets in key order, followed by the nodes left behind */
+    struct list_head *tail = head;
+    for (size_t i = 0; i < nr; i++) {
+        tail->next = buckets[i].head;
+        buckets[i].head->prev = tail;
+        tail = buckets[i].tail;
+    }
+    sort_stat_work(0, 2 * nr + 2);
+    tail->next = node;
+    node->prev = tail;
+
+    return node == head;
+}
+
+/* The low-cardinality engine; falls back to list_sort() if the input has too
+ * many distinct keys */
+void lowcard_sort(void *priv, struct list_head *head, list_cmp_func_t cmp)
+{
+    if (!lowcard_sort_try(priv, head, cmp))
+        list_sort(priv, head, cmp);
+}
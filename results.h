@@ -0,0 +1,242 @@
+/* The results file the client appends to, shared with the tools reading it
+ * back.
+ *
+ * The file starts with `RESULTS_MAGIC` and `RESULTS_VERSION`, followed by
+ * blocks of a `struct results_block` and its payload:
+ *
+ *   RESULTS_RUN     a `struct results_run` describing the machine, written
+ *                   each time the client starts
+ *   RESULTS_RECORD  a `struct results_record` of one (engine, case, size),
+ *                   followed by `nr_buckets` non-empty buckets of the
+ *                   histogram of its durations
+ *
+ * The records belong to the last run before them. All the fields are in the
+ * byte order of the machine which wrote them.
+ */
+#ifndef RESULTS_H
+#define RESULTS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "hist.h"
+#include "sort_test_ioctl.h"
+
+/* The engines, in the order of `tests[]` in the driver */
+static const char *const engine_names[] = {
+    "listsort",
+    "timsort_merge",
+    "timsort_linear",
+    "timsort_binary",
+    "timsort_gallop",
+    "timsort_b_gallop",
+    "adaptive_shiverssort",
+    "adaptive_shiverssort_merge",
+    "lowcard",
+    "timsort_sliced",
+    "llist_sort",
+    "llist_timsort_b_gallop",
+    "llist_shiverssort",
+    "llist_via_listsort",
+    "llist_via_timsort_b_gallop",
+    "llist_via_shiverssort",
+    "tail_listsort",
+    "tail_full_listsort",
+    "tail_full_timsort_b_gallop",
+    NULL,
+};
+
+#define NR_ENGINES ((int) (sizeof(engine_names) / sizeof(*engine_names)) - 1)
+
+/* The short names of the test cases */
+static const char *const case_names[] = {
+    "w",     /* Worst case of merge sort */
+    "r3",    /* Random 3 elements */
+    "rl10",  /* Random last 10 elements */
+    "r1p",   /* Random 1% elements */
+    "dup",   /* Duplicate */
+    "r",     /* Random elements */
+    "trace", /* The keys of a trace, see `SORT_CASE_TRACE` */
+    "plug",   /* The call sites from `SORT_CASE_SITE` on */
+    "inode",
+    "extent",
+};
+
+#define NR_CASES ((int) (sizeof(case_names) / sizeof(*case_names)))
+
+#define RESULTS_MAGIC "SORTRES"
+#define RESULTS_VERSION 1
+
+enum results_block_type {
+    RESULTS_RUN = 1,
+    RESULTS_RECORD,
+};
+
+struct results_block {
+    uint32_t type;
+    uint32_t size; /* the bytes of the payload */
+};
+
+struct results_run {
+    int64_t time; /* the start of the run, in seconds since the epoch */
+    char kernel[65];
+    char cpu_model[64];
+    /* the `name=value` module parameters of the driver */
+    char params[256];
+};
+
+struct results_record {
+    char engine[32];
+    char case_name[8];
+    uint32_t cpu; /* the CPU the last iteration ran on */
+    uint32_t loop;
+    uint64_t size;
+    /* the seed of the samples, iteration `i` sorted its `i`-th stream */
+    uint64_t seed;
+    /* the percentiles of the durations and of the longest stretches between
+     * rescheduling points */
+    uint64_t time_p50, time_p90, time_p99, time_p999, time_max;
+    uint64_t gap_p50, gap_p99, gap_max;
+    /* the means over the iterations and the 95% confidence half widths */
+    double time_mean, time_ci95, count_mean, count_ci95, k_mean, runs_mean;
+    /* the comparisons and the merge cost over n * H, NaN for single runs */
+    double cmp_nh_mean, cost_nh_mean;
+    double resched_mean, yield_mean;
+    double phase_cmps[SORT_PHASE_NR];
+    double phase_visits[SORT_PHASE_NR];
+    double phase_writes[SORT_PHASE_NR];
+    uint32_t nr_buckets;
+    /* the CPUs sorting at once, see `concurrent` of the driver */
+    uint32_t cpus;
+    /* the dTLB load misses, see `count_dtlb` of the driver; 0 unless it
+     * counted them */
+    double tlb_mean;
+};
+
+struct results_bucket {
+    uint32_t idx;
+    uint32_t count;
+};
+
+/* Open the results file `name` for appending, writing the magic first if it is
+ * a new file. Returns NULL if it isn't a results file of this version. */
+static inline FILE *results_open(const char *name)
+{
+    FILE *file = fopen(name, "a+b");
+    if (!file)
+        return NULL;
+
+    char magic[sizeof(RESULTS_MAGIC)];
+    uint32_t version;
+    if (fseek(file, 0, SEEK_END) || !ftell(file)) {
+        version = RESULTS_VERSION;
+        fwrite(RESULTS_MAGIC, sizeof(magic), 1, file);
+        fwrite(&version, sizeof(version), 1, file);
+        return file;
+    }
+
+    rewind(file);
+    if (fread(magic, sizeof(magic), 1, file) != 1 ||
+        fread(&version, sizeof(version), 1, file) != 1 ||
+        memcmp(magic, RESULTS_MAGIC, sizeof(magic)) ||
+        version != RESULTS_VERSION) {
+        fclose(file);
+        return NULL;
+    }
+    return file;
+}
+
+static inline void results_write_run(FILE *file, const struct results_run *run)
+{
+    struct results_block block = {RESULTS_RUN, sizeof(*run)};
+
+    fwrite(&block, sizeof(block), 1, file);
+    fwrite(run, sizeof(*run), 1, file);
+}
+
+/* Append `rec` with the non-empty buckets of `h` */
+static inline void results_write_record(FILE *file,
+                                        struct results_record *rec,
+                                        const struct hist *h)
+{
+    struct results_bucket buckets[HIST_BUCKETS];
+
+    rec->nr_buckets = 0;
+    for (unsigned int i = 0; i < HIST_BUCKETS; i++)
+        if (h->counts[i])
+            buckets[rec->nr_buckets++] =
+                (struct results_bucket){.idx = i, .count = h->counts[i]};
+
+    struct results_block block = {
+        RESULTS_RECORD,
+        sizeof(*rec) + rec->nr_buckets * sizeof(*buckets),
+    };
+    fwrite(&block, sizeof(block), 1, file);
+    fwrite(rec, sizeof(*rec), 1, file);
+    fwrite(buckets, sizeof(*buckets), rec->nr_buckets, file);
+}
+
+/* Open the results file `name` for reading, positioned at the first block */
+static inline FILE *results_open_read(const char *name)
+{
+    FILE *file = fopen(name, "rb");
+    if (!file)
+        return NULL;
+
+    char magic[sizeof(RESULTS_MAGIC)];
+    uint32_t version;
+    if (fread(magic, sizeof(magic), 1, file) != 1 ||
+        fread(&version, sizeof(version), 1, file) != 1 ||
+        memcmp(magic, RESULTS_MAGIC, sizeof(magic)) ||
+        version != RESULTS_VERSION) {
+        fclose(file);
+        return NULL;
+    }
+    return file;
+}
+
+/* Read the next record, keeping the last run before it in `run`. The histogram
+ * is only read if `h` isn't NULL. Returns false at the end of the file. */
+static inline bool results_next(FILE *file,
+                                struct results_run *run,
+                                struct results_record *rec,
+                                struct hist *h)
+{
+    struct results_block block;
+
+    while (fread(&block, sizeof(block), 1, file) == 1) {
+        if (block.type == RESULTS_RUN && block.size == sizeof(*run)) {
+            if (fread(run, sizeof(*run), 1, file) != 1)
+                return false;
+            continue;
+        }
+        if (block.type != RESULTS_RECORD || block.size < sizeof(*rec)) {
+            /* skip the blocks of the later versions */
+            if (fseek(file, block.size, SEEK_CUR))
+                return false;
+            continue;
+        }
+
+        if (fread(rec, sizeof(*rec), 1, file) != 1)
+            return false;
+        if (!h)
+            return !fseek(file, block.size - sizeof(*rec), SEEK_CUR);
+
+        hist_reset(h);
+        for (uint32_t i = 0; i < rec->nr_buckets; i++) {
+            struct results_bucket bucket;
+            if (fread(&bucket, sizeof(bucket), 1, file) != 1 ||
+                bucket.idx >= HIST_BUCKETS)
+                return false;
+            h->counts[bucket.idx] = bucket.count;
+            h->total += bucket.count;
+        }
+        h->max = rec->time_max;
+        return true;
+    }
+    return false;
+}
+
+#endif
@@ -3,10 +3,19 @@
 
 #include <linux/types.h>
 
+#include "sort_test_ioctl.h"
+
 struct list_head;
+struct llist_node;
 
 #define MAX_LEN ((1 << 20) + 20)
 #define MIN_LEN 4
+/* The tests beyond `MAX_LEN` nodes need the elements from an arena, see
+ * `enum sort_arena` */
+#define LARGE_MAX_LEN (1 << 28)
+
+/* The upper bound of the minrun computed by the timsort engines */
+#define MAX_MINRUN 32
 
 /* In the compare function, `void *` is a argument that could be used to
  * record the number of comparisons
@@ -18,10 +27,74 @@ typedef void (*test_func_t)(void *priv,
                             struct list_head *head,
                             list_cmp_func_t cmp);
 
+/* The compare function of the engines of singly linked lists */
+typedef int __attribute__((nonnull(2,3))) (*llist_cmp_func_t)(void *,
+		const struct llist_node *, const struct llist_node *);
+
+/* The tests sorting a null-terminated singly linked list, with the compare
+ * functions of both kinds of nodes, returning its first node */
+typedef struct llist_node *(*llist_test_func_t)(void *priv,
+                                                struct llist_node *list,
+                                                list_cmp_func_t cmp,
+                                                llist_cmp_func_t llist_cmp);
+
+/* Attributing the work of the engines to the phases in `enum sort_phase`.
+ *
+ * The comparisons are counted into the current phase by the compare function
+ * of the test driver. The node visits and the pointer writes are only counted
+ * when building with `STATS=1`, so they don't disturb the measured durations.
+ *
+ * None of them, nor the merge cost below, is written while `sort_stats_on` is
+ * cleared, which the driver does when several sorts run at once, as they
+ * would share the counters.
+ */
+extern unsigned int sort_phase;
+extern struct sort_phase_stats sort_stats;
+extern bool sort_stats_on;
+
+#define sort_stat_phase(p)    \
+    do {                      \
+        if (sort_stats_on)    \
+            sort_phase = (p); \
+    } while (0)
+#ifdef SORT_TEST_STATS
+#define sort_stat_work(v, w)                      \
+    do {                                          \
+        if (sort_stats_on) {                      \
+            sort_stats.visits[sort_phase] += (v); \
+            sort_stats.writes[sort_phase] += (w); \
+        }                                         \
+    } while (0)
+#else
+#define sort_stat_work(v, w) \
+    do {                     \
+    } while (0)
+#endif
+
+/* The merge cost of the last sort, i.e. the sum of the lengths of every merge
+ * including the final one. Unlike the visits and the writes, it is counted
+ * without `STATS=1` since it only costs one addition per merge.
+ */
+extern u64 sort_merge_cost;
+
+#define sort_stat_cost(n)           \
+    do {                            \
+        if (sort_stats_on)          \
+            sort_merge_cost += (n); \
+    } while (0)
+
 /* Structure for the test cases */
 typedef struct {
     char *name;
     test_func_t impl;
+    /* instead of `impl`, the test is given the list as an llist */
+    llist_test_func_t llist_impl;
+    /* the engine runs without the low-cardinality fallback, like the
+     * engines it is the baseline of */
+    bool no_lowcard;
+    /* the input is sorted but for the nodes appended last, see
+     * list_sort_tail() */
+    bool sorted_prefix;
 } test_t;
 
 
@@ -39,5 +112,61 @@ void timsort_l_gallop(void *priv, struct list_head *head, list_cmp_func_t cmp);
 void timsort_b_gallop(void *priv, struct list_head *head, list_cmp_func_t cmp);
 void shiverssort(void *priv, struct list_head *head, list_cmp_func_t cmp);
 void shiverssort_merge(void *priv, struct list_head *head, list_cmp_func_t cmp);
+void lowcard_sort(void *priv, struct list_head *head, list_cmp_func_t cmp);
+void timsort_sliced(void *priv, struct list_head *head, list_cmp_func_t cmp);
+
+/* The engines of null-terminated singly linked lists, e.g. from
+ * llist_del_all(), returning the first node of the sorted list. They are
+ * stable and keep no prev links. */
+struct llist_node *llist_sort(void *priv,
+                              struct llist_node *list,
+                              llist_cmp_func_t cmp);
+struct llist_node *llist_timsort_b_gallop(void *priv,
+                                          struct llist_node *list,
+                                          llist_cmp_func_t cmp);
+struct llist_node *llist_shiverssort(void *priv,
+                                     struct llist_node *list,
+                                     llist_cmp_func_t cmp);
+
+/* Sort `head` whose nodes up to `last` are already sorted, e.g. after
+ * appending to a sorted list, by sorting the nodes after `last` with `sort`
+ * and galloping them into the sorted ones, see `sort_tail.c` */
+void list_sort_tail(void *priv,
+                    struct list_head *head,
+                    struct list_head *last,
+                    list_cmp_func_t cmp,
+                    test_func_t sort);
+
+/* The state of a time-sliced timsort between its calls, see
+ * `timsort_sliced.c`. It is filled by timsort_slice_init(), and the sort goes
+ * on for at most `budget` nodes per call of timsort_slice(), which returns
+ * true once `head` is sorted. */
+struct timsort_slice {
+    struct list_head *head;
+    struct list_head *list; /* the rest of the input, or of the final links */
+    struct list_head *tp;   /* the top of the run stack */
+    size_t stk_size;
+    int step;
+    /* the run being scanned */
+    struct list_head *run, *cur;
+    size_t run_len;
+    bool descending;
+    /* the merge in progress, of the runs `a` and `b` into `merged` */
+    struct list_head *a, *b, *merged, **tail;
+    struct list_head *above, *below, *link_tail;
+    size_t merge_len;
+};
+
+void timsort_slice_init(struct timsort_slice *st, struct list_head *head);
+bool timsort_slice(void *priv,
+                   list_cmp_func_t cmp,
+                   struct timsort_slice *st,
+                   size_t budget);
+
+/* The low-cardinality fallback of the adaptive engines, see `lowcard.c`.
+ * `lowcard_fallback` is set from the `lowcard_fallback` module parameter in
+ * `lowcard_param` for each test. */
+extern bool lowcard_fallback, lowcard_param;
+bool lowcard_sort_try(void *priv, struct list_head *head, list_cmp_func_t cmp);
 
 #endif
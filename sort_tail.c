@@ -0,0 +1,120 @@
+#include <linux/kernel.h>
+#include <linux/compiler.h>
+#include <linux/export.h>
+#include <linux/list.h>
+
+#include "sort.h"
+
+/* Sorting a list of n sorted nodes followed by k appended ones, as after adding
+ * a batch of entries to a sorted list. Only the k nodes are sorted, by one of
+ * the engines, and each of them is then galloped into the sorted nodes from
+ * where the one before it went. The sort takes O(k log k) comparisons and the
+ * merge O(k log(n/k)), and only the k nodes are relinked. The gallops still
+ * walk over up to all of the n nodes, which a linked list can't skip.
+ */
+
+/* The first node from `pos` on which goes after `node`, or `head` if none,
+ * found by an exponential search followed by a binary search. The nodes equal
+ * to `node` go before it, being earlier in the list -- important for sort
+ * stability */
+static struct list_head *gallop(void *priv,
+                                list_cmp_func_t cmp,
+                                struct list_head *head,
+                                struct list_head *pos,
+                                struct list_head *node,
+                                u8 *count)
+{
+    struct list_head *last = NULL, *probe = pos;
+    size_t gap = 0, step = 1;
+
+    /* Find a node which goes after `node`, `last` being the last one known
+     * not to and `gap` the nodes between them */
+    sort_stat_phase(SORT_PHASE_GALLOP_SEARCH);
+    while (probe != head && cmp(priv, probe, node) <= 0) {
+        last = probe;
+        for (gap = 0; gap < step && probe != head; gap++) {
+            /* the steps grow with the list, call back while walking them */
+            if (unlikely(!++*count))
+                cmp(priv, probe, probe);
+            probe = probe->next;
+            sort_stat_work(1, 0);
+        }
+        gap--;
+        step <<= 1;
+    }
+
+    /* The binary search of the gap, walking to the middle node each time */
+    while (gap) {
+        size_t half = gap >> 1;
+        struct list_head *middle = last->next;
+
+        for (size_t i = 0; i < half; i++) {
+            if (unlikely(!++*count))
+                cmp(priv, middle, middle);
+            middle = middle->next;
+            sort_stat_work(1, 0);
+        }
+        if (cmp(priv, middle, node) <= 0) {
+            last = middle;
+            gap -= half + 1;
+        } else {
+            gap = half;
+        }
+    }
+
+    return last ? last->next : pos;
+}
+
+/* Sort `head`, whose nodes up to `last` are sorted, sorting the nodes after
+ * `last` with `sort` and merging them into the ones before. `last` is `head`
+ * if none of the nodes are sorted. */
+void list_sort_tail(void *priv,
+                    struct list_head *head,
+                    struct list_head *last,
+                    list_cmp_func_t cmp,
+                    test_func_t sort)
+{
+    struct list_head tail, *pos, *node, *next;
+    u8 count = 0;
+
+    if (last == head) {
+        sort(priv, head, cmp);
+        return;
+    }
+    if (last == head->prev)
+        return;
+
+    /* Cut the appended nodes off, and sort them on their own */
+    tail.next = last->next;
+    tail.next->prev = &tail;
+    tail.prev = head->prev;
+    tail.prev->next = &tail;
+    last->next = head;
+    head->prev = last;
+    sort(priv, &tail, cmp);
+
+    /* Insert each of them before the first sorted node going after it, which
+     * the next one can't go before */
+    pos = head->next;
+    for (node = tail.next; node != &tail; node = next) {
+        next = node->next;
+        pos = gallop(priv, cmp, head, pos, node, &count);
+        if (pos == head) {
+            /* The rest go after all the sorted nodes */
+            sort_stat_phase(SORT_PHASE_GALLOP_INSERT);
+            node->prev = head->prev;
+            head->prev->next = node;
+            tail.prev->next = head;
+            head->prev = tail.prev;
+            sort_stat_work(0, 4);
+            return;
+        }
+
+        sort_stat_phase(SORT_PHASE_GALLOP_INSERT);
+        node->prev = pos->prev;
+        node->next = pos;
+        pos->prev->next = node;
+        pos->prev = node;
+        sort_stat_work(0, 4);
+    }
+}
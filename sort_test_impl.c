@@ -1,4 +1,9 @@
 #include "list.h"
+#include <linux/sched.h>
+
+/* The walks of the large tests reschedule every `WORST_CHUNK` nodes, as the
+ * other loops over the samples do */
+#define WORST_CHUNK (1 << 16)
 
 /**
  * A function to join the split list with the guarantee of the `next` pointer
@@ -9,10 +14,17 @@ static struct list_head *worst_merge_join(struct list_head *left_head,
 {
     struct list_head *head = NULL;
     struct list_head **p = &head;
-    for (; left_head; p = &((*p)->next), left_head = left_head->next)
+    size_t count = 0;
+    for (; left_head; p = &((*p)->next), left_head = left_head->next) {
         *p = left_head;
-    for (; right_head; p = &((*p)->next), right_head = right_head->next)
+        if (!(++count % WORST_CHUNK))
+            cond_resched();
+    }
+    for (; right_head; p = &((*p)->next), right_head = right_head->next) {
         *p = right_head;
+        if (!(++count % WORST_CHUNK))
+            cond_resched();
+    }
     return head;
 }
 
@@ -24,12 +36,16 @@ static struct list_head *worst_merge_split(struct list_head *head)
 {
     if (head != NULL && head->next != NULL) {
         struct list_head *left_head = NULL, *right_head = NULL;
+        /* every level walks the whole list */
+        cond_resched();
         // Find the left_head and right_head
         struct list_head *curr = head;
         struct list_head **pl = &left_head;
         struct list_head **pr = &right_head;
         // apply the code with pointer of pointer
         for (int count = 1; curr != NULL; curr = curr->next, count++) {
+            if (!(count % WORST_CHUNK))
+                cond_resched();
             if (count % 2) {  // odd case
                 *pl = curr;
                 pl = &((*pl)->next);
@@ -64,8 +80,12 @@ void worst_case_generator(struct list_head *head)
     head->next = worst_merge_split(head->next);
     // make the list be circular again
     struct list_head *curr;
-    for (curr = head; curr->next; curr = curr->next)
+    size_t count = 0;
+    for (curr = head; curr->next; curr = curr->next) {
         curr->next->prev = curr;
+        if (!(++count % WORST_CHUNK))
+            cond_resched();
+    }
     curr->next = head;
     curr->next->prev = curr;
 }
\ No newline at end of file
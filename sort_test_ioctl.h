@@ -0,0 +1,163 @@
+#ifndef SORT_TEST_IOCTL_H
+#define SORT_TEST_IOCTL_H
+
+/* The interface shared between the `sort_test` device driver and the user
+ * space client
+ */
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+/* The phases of the sorting engines which the work is attributed to */
+enum sort_phase {
+    SORT_PHASE_RUN_DETECT,    /* scanning for a natural run */
+    SORT_PHASE_RUN_REVERSE,   /* scanning and reversing a descending run */
+    SORT_PHASE_INSERTION,     /* extending a run to minrun */
+    SORT_PHASE_MERGE,         /* the merges before the final one */
+    SORT_PHASE_GALLOP_SEARCH, /* the exponential search of galloping mode */
+    SORT_PHASE_GALLOP_INSERT, /* the insertion of galloping mode */
+    SORT_PHASE_MERGE_FINAL,   /* the final merge and the prev links rebuild */
+    SORT_PHASE_BUCKET,        /* the low-cardinality bucketing */
+    SORT_PHASE_NR,
+};
+
+#define SORT_PHASE_NAMES                                                   \
+    {                                                                      \
+        "run_detect", "run_reverse", "insertion", "merge", "gallop_search", \
+            "gallop_insert", "merge_final", "bucket",                      \
+    }
+
+/* The work of the last measured sort in each phase. The node visits and the
+ * pointer writes are only counted when the module is built with `STATS=1`.
+ */
+struct sort_phase_stats {
+    __u64 cmps[SORT_PHASE_NR];
+    __u64 visits[SORT_PHASE_NR];
+    __u64 writes[SORT_PHASE_NR];
+};
+
+/* The case sorting the keys recorded in a trace, e.g. the sectors of the
+ * requests on blk-mq plug lists. The client maps the device with mmap() at
+ * offset 0, which gives a buffer of up to 2^20 + 20 keys of `__u64`, and
+ * writes the keys there. The samples of a test of `n` nodes are the first `n`
+ * keys of the buffer.
+ */
+#define SORT_CASE_TRACE 6
+
+/* The cases replicating list_sort() call sites of the kernel, with elements,
+ * comparators and keys of their own:
+ *
+ *   SORT_CASE_SITE      the plug list of blk-mq, by queue and sector
+ *   SORT_CASE_SITE + 1  the ordered write inodes of gfs2, by disk address
+ *   SORT_CASE_SITE + 2  the busy extents of xfs, by group and block
+ */
+#define SORT_CASE_SITE 7
+
+/* The cost models of the comparator, selected by the `cmp_cost` module
+ * parameter */
+enum sort_cmp_cost {
+    SORT_CMP_INT,      /* a cheap integer comparison */
+    SORT_CMP_SPIN,     /* spinning `cmp_spin` cycles before comparing */
+    SORT_CMP_MEMCMP,   /* memcmp() over a key buffer of `cmp_key_bytes` */
+    SORT_CMP_INDIRECT, /* looking the keys up in a separate key table */
+    SORT_CMP_NR,
+};
+
+/* The types of the keys, selected by the `key_type` module parameter */
+enum sort_key_type {
+    SORT_KEY_INT,    /* int */
+    SORT_KEY_U64,    /* u64 using all the 64 bits */
+    SORT_KEY_MULTI,  /* three words compared in turn */
+    SORT_KEY_STRING, /* fixed length strings with a long common prefix */
+    SORT_KEY_ADDR,   /* the addresses of objects */
+    SORT_KEY_TYPE_NR,
+};
+
+/* The placements of the key, selected by the `key_layout` module parameter */
+enum sort_key_layout {
+    SORT_KEY_SAME_LINE,  /* next to the list_head */
+    SORT_KEY_OTHER_LINE, /* behind the payload, on another cache line */
+    SORT_KEY_POINTER,    /* in a separate allocation */
+    SORT_KEY_NR,
+};
+
+/* The memory the elements are allocated from, selected by the `arena` module
+ * parameter. The tests of more than 2^20 + 20 nodes, up to 2^28, need an arena;
+ * they are sorted preemptibly and without a warmup. */
+enum sort_arena {
+    SORT_ARENA_KMALLOC, /* a kmalloc() per element */
+    SORT_ARENA_VMALLOC, /* carved from vmalloc() chunks mapped by 4K pages */
+    SORT_ARENA_HUGE,    /* carved from 2M pages of the direct map */
+    SORT_ARENA_SPARSE,  /* an element or key per 4K page, up to 4K of each,
+                           and not for the large tests */
+    SORT_ARENA_NR,
+};
+
+/* The result of a read() on the device is the text line
+ *
+ *   <duration> <comparisons> <runs> <n * H> <merge cost> <max stretch>
+ *   <resched points> <yielded> <cpus> <cpu> <dTLB misses>
+ *
+ * where `runs` and the run-length entropy `H` describe the natural runs of the
+ * input, and `n * H` is in fixed point with `SORT_TEST_NH_SHIFT` fractional
+ * bits. The longest stretch between the cond_resched() callbacks of the engine
+ * and the time given to the other tasks at them are in nanoseconds.
+ *
+ * `cpus` is the number of CPUs which sorted at once, 1 unless the `concurrent`
+ * module parameter is set. The line is then of the slowest of their sorts, with
+ * no merge cost, and the sorts of every CPU are listed in
+ * `/sys/kernel/debug/sort_test/cpus`. `cpu` is the CPU the sort started on,
+ * which is on the node of the `sort_node` module parameter if it is set.
+ *
+ * The dTLB misses of the loads of the sort are only counted if the `count_dtlb`
+ * module parameter is set, and are 0 otherwise.
+ */
+#define SORT_TEST_NH_SHIFT 16
+
+/* The longest result line, with its terminating NUL */
+#define SORT_TEST_LINE 256
+
+/* The tests can also be queued as jobs with `SORT_TEST_IOC_SUBMIT`, which a
+ * kthread bound to the CPU of the `job_cpu` module parameter runs one at a
+ * time, in the order they were submitted by all the files. Each file has up to
+ * `SORT_TEST_JOBS` jobs in flight, from their submission to the fetch of their
+ * results with `SORT_TEST_IOC_RESULT`, which fails with `EAGAIN` when the jobs
+ * are all in flight or none has finished. poll() on the file reports POLLIN
+ * when a job has finished and POLLOUT when another can be submitted. The
+ * parameters of the driver are those when the job starts.
+ */
+#define SORT_TEST_JOBS 64
+
+/* A test, as the "<nodes> <case> <engine> <seed> <iteration>" of write() */
+struct sort_test_job {
+    __u32 nodes;
+    __u32 case_id;
+    __u32 sort_id;
+    __u32 iteration;
+    __u64 seed;
+    __u64 cookie; /* returned with the results */
+};
+
+struct sort_test_job_result {
+    __u64 cookie;
+    /* 0, or the negative errno of the test, which is `EILSEQ` if the list
+     * wasn't sorted */
+    __s32 status;
+    __u32 pad;
+    char line[SORT_TEST_LINE]; /* the result line of read() */
+    struct sort_phase_stats phases;
+};
+
+#define SORT_TEST_IOC_MAGIC 's'
+#define SORT_TEST_IOC_PHASES \
+    _IOR(SORT_TEST_IOC_MAGIC, 1, struct sort_phase_stats)
+#define SORT_TEST_IOC_SUBMIT \
+    _IOW(SORT_TEST_IOC_MAGIC, 2, struct sort_test_job)
+#define SORT_TEST_IOC_RESULT \
+    _IOR(SORT_TEST_IOC_MAGIC, 3, struct sort_test_job_result)
+/* The bytes of memory each node of the synthetic cases takes under the current
+ * parameters: the element and any key of its own, as kmalloc() rounds them or
+ * as the arena aligns them, and its entry of the key table. Fails with `EINVAL`
+ * if the parameters are invalid. */
+#define SORT_TEST_IOC_NODE_BYTES _IOR(SORT_TEST_IOC_MAGIC, 4, __u64)
+
+#endif
@@ -1,8 +1,12 @@
 #include <linux/kernel.h> /* We're doing kernel work */ 
 #include <linux/uaccess.h> /* for copy_from/to_user*/ 
 #include <linux/cdev.h>
+#include <linux/completion.h>
+#include <linux/cpu.h>
+#include <linux/debugfs.h>
 #include <linux/fs.h>
 #include <linux/init.h>
+#include <linux/kthread.h>
 #include <linux/module.h>
 #include <linux/slab.h>
 #include <linux/version.h>
@@ -10,8 +14,35 @@
 #include <linux/errno.h>
 #include <linux/string.h>
 #include <linux/list.h>
+#include <linux/llist.h>
+#include <linux/cache.h>
+#include <linux/log2.h>
+#include <linux/mm.h>
+#include <linux/moduleparam.h>
+#include <linux/mutex.h>
+#include <linux/nodemask.h>
+#include <linux/numa.h>
+#include <linux/overflow.h>
+#include <linux/perf_event.h>
+#include <linux/poll.h>
+#include <linux/sort.h>
+#include <linux/vmalloc.h>
+#include <linux/workqueue.h>
+#include <linux/timex.h>
+#include <linux/topology.h>
+#include <linux/sched/clock.h>
+#include <linux/sched/task.h>
+#include <linux/seq_file.h>
+#include <linux/sizes.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
 
 #include "sort.h"
+#include "sort_test_ioctl.h"
+#include "xoroshiro128p.h"
+
+#define CREATE_TRACE_POINTS
+#include "sort_trace.h"
 
 MODULE_LICENSE("Dual MIT/GPL");
 MODULE_AUTHOR("National Cheng Kung University, Taiwan");
@@ -20,50 +51,1076 @@ MODULE_VERSION("0.1");
 
 #define DEVICE_NAME "sort_test"
 
-/* The function from xoroshiro128p */
-extern void seed(uint64_t, uint64_t);
-extern void jump(void);
-extern uint64_t next(void);
-
 /* The extern function from `sort_test_impl` */
 extern void worst_case_generator(struct list_head *head);
 
-/* The structure of the linked-list in this test */
+/* The structure of the linked-list in this test. The comparators read the key
+ * through `key`, which points either into the element (next to `list` or
+ * behind the payload in `data`) or to a separate allocation, see
+ * `enum sort_key_layout`.
+ */
 typedef struct {
     int value;
     struct list_head list;
     int seq;
+    void *key;
+    u8 data[];
 } element_t;
 
+/* The cost model of the comparator, see `enum sort_cmp_cost` */
+static int cmp_cost = SORT_CMP_INT;
+module_param(cmp_cost, int, 0644);
+MODULE_PARM_DESC(cmp_cost,
+                 "Comparator cost: 0 int, 1 spin, 2 memcmp, 3 indirect key");
+
+static uint cmp_spin = 100;
+module_param(cmp_spin, uint, 0644);
+MODULE_PARM_DESC(cmp_spin, "Cycles spun by each comparison of cmp_cost=1");
+
+static uint cmp_key_bytes = 64;
+module_param(cmp_key_bytes, uint, 0644);
+MODULE_PARM_DESC(cmp_key_bytes,
+                 "Bytes of the key buffer compared by cmp_cost=2 (>= 4)");
+
+/* The type of the keys, see `enum sort_key_type` */
+static int key_type = SORT_KEY_INT;
+module_param(key_type, int, 0644);
+MODULE_PARM_DESC(key_type,
+                 "Key type: 0 int, 1 u64, 2 multi-word, 3 string, 4 address");
+
+/* The payload making the elements as large as real kernel objects */
+static uint elem_payload;
+module_param(elem_payload, uint, 0644);
+MODULE_PARM_DESC(elem_payload, "Bytes of payload in each element (<= 4096)");
+
+static int key_layout = SORT_KEY_SAME_LINE;
+module_param(key_layout, int, 0644);
+MODULE_PARM_DESC(key_layout,
+                 "Key placement: 0 same line, 1 other line, 2 behind a pointer");
+
+/* The memory the elements come from, see `enum sort_arena` */
+static int arena = SORT_ARENA_KMALLOC;
+module_param(arena, int, 0644);
+MODULE_PARM_DESC(arena,
+                 "Element memory: 0 kmalloc, 1 vmalloc arena, 2 huge page arena, "
+                 "3 sparse arena");
+
+/* The NUMA nodes the samples are allocated on and the sort runs on, for
+ * measuring the cost of sorting a list in the memory of another node. Each is
+ * -1 (NUMA_NO_NODE) to leave it to the allocator and the scheduler. */
+static int sample_node = NUMA_NO_NODE;
+module_param(sample_node, int, 0644);
+MODULE_PARM_DESC(sample_node,
+                 "NUMA node of the elements and their keys (-1 for any)");
+
+static int sort_node = NUMA_NO_NODE;
+module_param(sort_node, int, 0644);
+MODULE_PARM_DESC(sort_node,
+                 "NUMA node of the CPU sorting them (-1 for the reader's CPU; "
+                 "not for the concurrent mode)");
+
+/* The cost model and the element layout of the running test, fixed when it
+ * starts so that changing the parameters can't affect a test in progress */
+static int cmp_model;
+static bool preempt_mode;
+static int key_kind;
+static uint key_bytes;
+static uint payload_bytes;
+static int layout;
+static int arena_kind;
+static int sample_nid;
+static bool dtlb_mode;
+static size_t tail_len;
+/* A test of more than `MAX_LEN` nodes, see `LARGE_MAX_LEN` */
+static bool large_mode;
+
+/* Sort with interrupts and preemption enabled, letting the cond_resched()
+ * callbacks of the engines reschedule */
+static bool preemptible;
+module_param(preemptible, bool, 0644);
+MODULE_PARM_DESC(preemptible,
+                 "Sort with interrupts and preemption on, rescheduling at the "
+                 "cond_resched() callbacks of the engines");
+
+/* Count the dTLB misses of the loads of the measured sort with a perf counter
+ * of the reading task, for telling the address translations apart from the
+ * rest of the cost of an engine, e.g. between the arenas. Reading the counter
+ * may sleep, so the sort is preemptible. */
+static bool count_dtlb;
+module_param(count_dtlb, bool, 0644);
+MODULE_PARM_DESC(count_dtlb,
+                 "Count the dTLB load misses of the measured sort (sorting "
+                 "preemptibly)");
+
+/* The tests with a sorted prefix sort the samples as the sorted list the last
+ * `tail_nodes` of them were appended to, see list_sort_tail() */
+static uint tail_nodes = 64;
+module_param(tail_nodes, uint, 0644);
+MODULE_PARM_DESC(tail_nodes,
+                 "Nodes appended to the sorted list in the tail_* tests");
+
+/* The keys of cmp_cost=3, indexed by the `seq` of the elements */
+static int *key_table;
+
+/* The multi-word key, compared the way the comment of list_sort() suggests */
+struct multi_key {
+    u32 high, middle, low;
+};
+
+/* The string keys are the values in fixed width decimal behind a long common
+ * prefix, like the paths or the names of the objects in a directory */
+#define KEY_STR_PREFIX "/sys/kernel/debug/sort_test/"
+#define KEY_STR_LEN (sizeof(KEY_STR_PREFIX) + 10)
+
+/* Three-way comparison, which can't overflow as a subtraction would */
+#define KEY_CMP(a, b) (((a) > (b)) - ((a) < (b)))
+
 static dev_t dev = -1;
 static struct cdev cdev;
 static struct class *class;
+static struct dentry *debugfs_dir;
+
+/* The work of the last measured sort in each phase, see `sort.h` */
+unsigned int sort_phase;
+struct sort_phase_stats sort_stats;
+static const char *const phase_names[] = SORT_PHASE_NAMES;
+u64 sort_merge_cost;
+bool sort_stats_on __read_mostly = true;
+
+/* The state of one sort, which the engines pass to the compare functions as
+ * `priv`. Each sort of the concurrent mode has its own. */
+struct sort_run {
+    size_t count; /* the comparisons */
+    /* The callbacks the engines make by comparing a node with itself, which
+     * are the only points a long sort may be rescheduled at. The stretches
+     * between them are the latency a task woken on this CPU would see without
+     * kernel preemption. */
+    u64 resched_last, resched_max_gap, resched_yield;
+    size_t resched_points;
+    unsigned int large_cmps;
+    /* whether the comparisons are counted into `sort_stats`, which only one
+     * sort at a time may do */
+    bool phases;
+    /* the results of the measured sort */
+    unsigned int cpu; /* which it started on */
+    ktime_t duration;
+    size_t runs;
+    u64 nh;
+    u64 dtlb_misses; /* 0 unless `count_dtlb` is set */
+};
+
+static int resched_point(struct sort_run *run, bool callback)
+{
+    u64 now = local_clock();
+
+    if (now - run->resched_last > run->resched_max_gap)
+        run->resched_max_gap = now - run->resched_last;
+    if (!callback)
+        return 0;
+
+    run->resched_points++;
+    if (preempt_mode) {
+        cond_resched();
+        /* the time given to the other tasks isn't a part of any stretch */
+        u64 resumed = local_clock();
+        run->resched_yield += resumed - now;
+        now = resumed;
+    }
+    run->resched_last = now;
+
+    return 0;
+}
+
+/* The comparisons between the rescheduling points the comparator makes in the
+ * large tests */
+#define LARGE_RESCHED_CMPS (1 << 16)
+
+/* Count a comparison, see count_cmp() */
+static inline int count_site_cmp(void *priv, int res)
+{
+    struct sort_run *run = priv;
+
+    if (!run)
+        return res;
+    run->count++;
+    if (run->phases)
+        sort_stats.cmps[sort_phase]++;
+    /* a large test takes seconds even for the engines without callbacks, so
+     * the comparator reschedules too rather than trip the soft lockup
+     * detector */
+    if (unlikely(large_mode) && !(++run->large_cmps % LARGE_RESCHED_CMPS))
+        resched_point(run, true);
+
+    return res;
+}
+
+/* Count a comparison of two elements which aren't equal; the comparisons of
+ * equal elements are not counted */
+static inline int count_cmp(void *priv, int res)
+{
+    if (!res)
+        return 0;
+
+    return count_site_cmp(priv, res);
+}
 
 /* The compare function for this linked-list structure */
 static int list_cmp(void *priv, const struct list_head *a, const struct list_head *b)
 {
+    if (unlikely(a == b))
+        return resched_point(priv, true);
+
     element_t *element_a = list_entry(a, element_t, list);
     element_t *element_b = list_entry(b, element_t, list);
 
-    /* `int` data type could know if the cmp is larger, equal, or less 
-     */
-    int res = element_a->value - element_b->value;
+    int res = KEY_CMP(*(int *) element_a->key, *(int *) element_b->key);
 
-    if (!res)
-        return 0;
-    
-    if (priv)
-        *((size_t *) priv) += 1;
+    return count_cmp(priv, res);
+}
+
+static int list_cmp_u64(void *priv, const struct list_head *a, const struct list_head *b)
+{
+    if (unlikely(a == b))
+        return resched_point(priv, true);
+
+    element_t *element_a = list_entry(a, element_t, list);
+    element_t *element_b = list_entry(b, element_t, list);
+
+    return count_cmp(priv, KEY_CMP(*(u64 *) element_a->key, *(u64 *) element_b->key));
+}
+
+static int list_cmp_multi(void *priv, const struct list_head *a, const struct list_head *b)
+{
+    if (unlikely(a == b))
+        return resched_point(priv, true);
+
+    struct multi_key *key_a = list_entry(a, element_t, list)->key;
+    struct multi_key *key_b = list_entry(b, element_t, list)->key;
+
+    if (key_a->high != key_b->high)
+        return count_cmp(priv, KEY_CMP(key_a->high, key_b->high));
+    if (key_a->middle != key_b->middle)
+        return count_cmp(priv, KEY_CMP(key_a->middle, key_b->middle));
+    return count_cmp(priv, KEY_CMP(key_a->low, key_b->low));
+}
+
+static int list_cmp_string(void *priv, const struct list_head *a, const struct list_head *b)
+{
+    if (unlikely(a == b))
+        return resched_point(priv, true);
+
+    element_t *element_a = list_entry(a, element_t, list);
+    element_t *element_b = list_entry(b, element_t, list);
+
+    return count_cmp(priv, strcmp(element_a->key, element_b->key));
+}
+
+/* The compare function of the objects sorted by their addresses */
+static int list_cmp_addr(void *priv, const struct list_head *a, const struct list_head *b)
+{
+    if (unlikely(a == b))
+        return resched_point(priv, true);
+
+    element_t *element_a = list_entry(a, element_t, list);
+    element_t *element_b = list_entry(b, element_t, list);
+
+    return count_cmp(priv, KEY_CMP(*(uintptr_t *) element_a->key,
+                                   *(uintptr_t *) element_b->key));
+}
+
+/* The compare functions of the llist engines, which sort the elements chained
+ * by the `next` of their list_heads as llist_nodes */
+#define LLIST_CMP(cmp)                                                        \
+    static int cmp##_llist(void *priv, const struct llist_node *a,           \
+                           const struct llist_node *b)                       \
+    {                                                                         \
+        return cmp(priv, (const struct list_head *) a,                        \
+                   (const struct list_head *) b);                             \
+    }
+
+LLIST_CMP(list_cmp)
+LLIST_CMP(list_cmp_u64)
+LLIST_CMP(list_cmp_multi)
+LLIST_CMP(list_cmp_string)
+LLIST_CMP(list_cmp_addr)
+
+static const list_cmp_func_t key_cmps[SORT_KEY_TYPE_NR] = {
+    [SORT_KEY_INT] = list_cmp,
+    [SORT_KEY_U64] = list_cmp_u64,
+    [SORT_KEY_MULTI] = list_cmp_multi,
+    [SORT_KEY_STRING] = list_cmp_string,
+    [SORT_KEY_ADDR] = list_cmp_addr,
+};
+
+static const llist_cmp_func_t llist_key_cmps[SORT_KEY_TYPE_NR] = {
+    [SORT_KEY_INT] = list_cmp_llist,
+    [SORT_KEY_U64] = list_cmp_u64_llist,
+    [SORT_KEY_MULTI] = list_cmp_multi_llist,
+    [SORT_KEY_STRING] = list_cmp_string_llist,
+    [SORT_KEY_ADDR] = list_cmp_addr_llist,
+};
+
+/* The compare function spinning `cmp_spin` cycles, like a comparator which
+ * has to chase pointers to reach its keys */
+static int list_cmp_spin(void *priv, const struct list_head *a, const struct list_head *b)
+{
+    if (unlikely(a == b))
+        return resched_point(priv, true);
 
+    cycles_t start = get_cycles();
+
+    while (get_cycles() - start < cmp_spin)
+        cpu_relax();
+
+    return key_cmps[key_kind](priv, a, b);
+}
+
+/* The compare function of `key_bytes` long keys sharing all but their last
+ * four bytes, so every memcmp() scans the whole buffer */
+static int list_cmp_memcmp(void *priv, const struct list_head *a, const struct list_head *b)
+{
+    if (unlikely(a == b))
+        return resched_point(priv, true);
+
+    element_t *element_a = list_entry(a, element_t, list);
+    element_t *element_b = list_entry(b, element_t, list);
+
+    return count_cmp(priv, memcmp(element_a->key, element_b->key, key_bytes));
+}
+
+/* The compare function looking the keys up in `key_table`, away from the
+ * nodes */
+static int list_cmp_indirect(void *priv, const struct list_head *a, const struct list_head *b)
+{
+    if (unlikely(a == b))
+        return resched_point(priv, true);
+
+    element_t *element_a = list_entry(a, element_t, list);
+    element_t *element_b = list_entry(b, element_t, list);
+
+    return count_cmp(priv, KEY_CMP(key_table[element_a->seq], key_table[element_b->seq]));
+}
+
+static const list_cmp_func_t cmp_funcs[SORT_CMP_NR] = {
+    [SORT_CMP_INT] = list_cmp,
+    [SORT_CMP_SPIN] = list_cmp_spin,
+    [SORT_CMP_MEMCMP] = list_cmp_memcmp,
+    [SORT_CMP_INDIRECT] = list_cmp_indirect,
+};
+
+LLIST_CMP(list_cmp_spin)
+LLIST_CMP(list_cmp_memcmp)
+LLIST_CMP(list_cmp_indirect)
+
+static const llist_cmp_func_t llist_cmp_funcs[SORT_CMP_NR] = {
+    [SORT_CMP_INT] = list_cmp_llist,
+    [SORT_CMP_SPIN] = list_cmp_spin_llist,
+    [SORT_CMP_MEMCMP] = list_cmp_memcmp_llist,
+    [SORT_CMP_INDIRECT] = list_cmp_indirect_llist,
+};
+
+/* The bytes of the key under the current cost model and key type */
+static size_t key_size(void)
+{
+    static const size_t sizes[SORT_KEY_TYPE_NR] = {
+        [SORT_KEY_INT] = sizeof(int),
+        [SORT_KEY_U64] = sizeof(u64),
+        [SORT_KEY_MULTI] = sizeof(struct multi_key),
+        [SORT_KEY_STRING] = KEY_STR_LEN,
+        [SORT_KEY_ADDR] = sizeof(uintptr_t),
+    };
+
+    return cmp_model == SORT_CMP_MEMCMP ? key_bytes : sizes[key_kind];
+}
+
+/* Fill the key of `value` of the current key type. Every key type preserves the
+ * order of the values, so the result is still checked on `value`. */
+static void set_key(void *key, int value)
+{
+    struct multi_key *multi = key;
+
+    switch (key_kind) {
+    case SORT_KEY_U64:
+        /* the value in the high half, so the keys differ in all 64 bits */
+        *(u64 *) key = (u64) value << 32 | (u32) (value * 0x9e3779b9U);
+        break;
+    case SORT_KEY_MULTI:
+        /* nearby values share their high words, so the comparisons often fall
+         * through to the later words */
+        multi->high = (u32) value >> 14;
+        multi->middle = (value >> 7) & 0x7f;
+        multi->low = value & 0x7f;
+        break;
+    case SORT_KEY_STRING:
+        snprintf(key, KEY_STR_LEN, KEY_STR_PREFIX "%010u", (u32) value);
+        break;
+    case SORT_KEY_ADDR:
+        /* the addresses of the objects in a virtual array of cache lines */
+        *(uintptr_t *) key = PAGE_OFFSET + (uintptr_t) value * L1_CACHE_BYTES;
+        break;
+    default:
+        *(int *) key = value;
+        break;
+    }
+}
+
+/* The memory of the samples is taken from `sample_nid` only, rather than
+ * quietly from another node, unless it is NUMA_NO_NODE. vmalloc_node() only
+ * prefers the node. */
+static gfp_t sample_gfp(void)
+{
+    return GFP_KERNEL | (sample_nid == NUMA_NO_NODE ? 0 : __GFP_THISNODE);
+}
+
+static void *sample_kmalloc(size_t size)
+{
+    return kmalloc_node(size, sample_gfp(), sample_nid);
+}
+
+static bool node_valid(int nid)
+{
+    return nid >= 0 && nid < MAX_NUMNODES && node_online(nid);
+}
+
+/* The arenas the elements and their keys are carved from unless they are
+ * kmalloc()ed one by one, in chunks of `ARENA_CHUNK` bytes which no object
+ * straddles. The chunks come from vmalloc(), mapped by 4K pages, or are 2M
+ * pages of the direct map, or are sparse, see arena_sparse_chunk(). They are
+ * only freed as a whole when the test is over. */
+#define ARENA_CHUNK SZ_2M
+
+struct arena {
+    void **chunks;
+    size_t nr, max;
+    size_t size; /* of the objects */
+    size_t used; /* the bytes used of the last chunk */
+};
+
+static struct arena element_arena, key_arena;
+
+/* The objects of the sparse arena a physical page is shared by */
+static size_t arena_sparse_objects(const struct arena *a)
+{
+    return PAGE_SIZE / a->size;
+}
+
+/* Prepare `a` for `nr` objects of `size` bytes, which the sparse arena only
+ * takes up to `PAGE_SIZE` of */
+static int arena_init(struct arena *a, size_t nr, size_t size)
+{
+    a->size = ALIGN(size, sizeof(long));
+    a->max = DIV_ROUND_UP(nr, ARENA_CHUNK / (arena_kind == SORT_ARENA_SPARSE
+                                                 ? PAGE_SIZE
+                                                 : a->size));
+    a->nr = 0;
+    a->used = ARENA_CHUNK;
+    a->chunks = kvcalloc(a->max, sizeof(*a->chunks), GFP_KERNEL);
+    return a->chunks ? 0 : -ENOMEM;
+}
+
+/* A chunk of the sparse arena, with every object on a 4K page of its own so
+ * that each node of a list takes a TLB entry of its own. The pages of
+ * consecutive objects map the same physical page, each object at another
+ * offset of it, so the arena takes no more memory than the others. */
+static void *arena_sparse_chunk(const struct arena *a)
+{
+    unsigned int nr = ARENA_CHUNK / PAGE_SIZE, shared = arena_sparse_objects(a);
+    struct page **pages = kmalloc_array(nr, sizeof(*pages), GFP_KERNEL);
+    void *chunk = NULL;
+    unsigned int i;
+
+    if (!pages)
+        return NULL;
+    for (i = 0; i < nr; i++) {
+        pages[i] = i % shared ? pages[i - 1]
+                              : alloc_pages_node(sample_nid, sample_gfp(), 0);
+        if (!pages[i])
+            break;
+    }
+    if (i == nr)
+        chunk = vmap(pages, nr, VM_MAP, PAGE_KERNEL);
+    if (!chunk) {
+        while (i--)
+            if (!(i % shared))
+                __free_page(pages[i]);
+    }
+
+    kfree(pages);
+    return chunk;
+}
+
+static void arena_sparse_free(const struct arena *a, void *chunk)
+{
+    size_t shared = arena_sparse_objects(a);
+
+    for (size_t offset = 0; offset < ARENA_CHUNK; offset += shared * PAGE_SIZE)
+        __free_page(vmalloc_to_page(chunk + offset));
+    vunmap(chunk);
+}
+
+static void *arena_alloc(struct arena *a)
+{
+    size_t step = arena_kind == SORT_ARENA_SPARSE ? PAGE_SIZE : a->size;
+
+    if (a->used + step > ARENA_CHUNK) {
+        void *chunk;
+
+        if (a->nr == a->max)
+            return NULL;
+        if (arena_kind == SORT_ARENA_HUGE) {
+            struct page *page =
+                alloc_pages_node(sample_nid,
+                                 sample_gfp() | __GFP_COMP | __GFP_NOWARN,
+                                 get_order(ARENA_CHUNK));
+            chunk = page ? page_address(page) : NULL;
+        } else if (arena_kind == SORT_ARENA_SPARSE) {
+            chunk = arena_sparse_chunk(a);
+        } else {
+            chunk = vmalloc_node(ARENA_CHUNK, sample_nid);
+        }
+        if (!chunk)
+            return NULL;
+        a->chunks[a->nr++] = chunk;
+        a->used = 0;
+    }
+
+    void *res = a->chunks[a->nr - 1] + a->used;
+    if (arena_kind == SORT_ARENA_SPARSE)
+        res += (a->used / PAGE_SIZE % arena_sparse_objects(a)) * a->size;
+    a->used += step;
     return res;
 }
 
+static void arena_free(struct arena *a)
+{
+    for (size_t i = 0; i < a->nr; i++) {
+        if (arena_kind == SORT_ARENA_HUGE)
+            free_pages((unsigned long) a->chunks[i], get_order(ARENA_CHUNK));
+        else if (arena_kind == SORT_ARENA_SPARSE)
+            arena_sparse_free(a, a->chunks[i]);
+        else
+            vfree(a->chunks[i]);
+    }
+    kvfree(a->chunks);
+    a->chunks = NULL;
+    a->nr = a->max = 0;
+}
+
+/* Whether the key of an element is stored in it after its payload or in
+ * `data`; an integer key on the same line is `value` itself */
+static bool key_inline(void)
+{
+    bool value_key = cmp_model != SORT_CMP_MEMCMP && key_kind == SORT_KEY_INT;
+
+    return layout != SORT_KEY_POINTER &&
+           !(layout == SORT_KEY_SAME_LINE && value_key);
+}
+
+static size_t element_size(void)
+{
+    return sizeof(element_t) + payload_bytes + (key_inline() ? key_size() : 0);
+}
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6, 1, 0)
+/* The size class kmalloc() serves `size` bytes from */
+static size_t kmalloc_size_roundup(size_t size)
+{
+    void *probe = kmalloc(size, GFP_KERNEL);
+    size_t res = probe ? ksize(probe) : size;
+
+    kfree(probe);
+    return res;
+}
+#endif
+
+/* The bytes of `size` bytes of an object of the current backing */
+static size_t object_bytes(size_t size)
+{
+    return arena_kind ? ALIGN(size, sizeof(long)) : kmalloc_size_roundup(size);
+}
+
+/* The memory taken by each node of the synthetic cases under the current
+ * parameters, see `SORT_TEST_IOC_NODE_BYTES`. The objects of the sparse arena
+ * share their physical pages, so they take as much of the caches as in the
+ * other arenas. */
+static u64 node_bytes(void)
+{
+    u64 bytes = object_bytes(element_size());
+
+    if (layout == SORT_KEY_POINTER)
+        bytes += object_bytes(key_size());
+    if (cmp_model == SORT_CMP_INDIRECT)
+        bytes += sizeof(*key_table);
+    return bytes;
+}
+
+/* Allocate an element of `value` laid out by `layout`:
+ *
+ *   same line:  | value | list | seq | key | [memcmp key] | payload |
+ *   other line: | value | list | seq | key | payload | key |
+ *   pointer:    | value | list | seq | key | payload |  ->  | key |
+ *
+ * An integer key on the same line is `value` itself.
+ */
+static element_t *alloc_element(int value, int seq)
+{
+    bool value_key = cmp_model != SORT_CMP_MEMCMP && key_kind == SORT_KEY_INT;
+    element_t *element = arena_kind ? arena_alloc(&element_arena)
+                                    : sample_kmalloc(element_size());
+    if (!element)
+        return NULL;
+
+    element->value = value;
+    element->seq = seq;
+    switch (layout) {
+    case SORT_KEY_SAME_LINE:
+        element->key = value_key ? (void *) &element->value
+                                 : (void *) element->data;
+        break;
+    case SORT_KEY_OTHER_LINE:
+        element->key = element->data + payload_bytes;
+        break;
+    default:
+        element->key = arena_kind ? arena_alloc(&key_arena)
+                                  : sample_kmalloc(key_size());
+        if (!element->key) {
+            if (!arena_kind)
+                kfree(element);
+            return NULL;
+        }
+        break;
+    }
+
+    switch (cmp_model) {
+    case SORT_CMP_MEMCMP: {
+        u8 *key = element->key;
+        /* the common prefix, followed by the value in big endian */
+        memset(key, 0, key_bytes - 4);
+        for (int i = 0; i < 4; i++)
+            key[key_bytes - 4 + i] = (u32) value >> (24 - 8 * i);
+        break;
+    }
+    case SORT_CMP_INDIRECT:
+        key_table[seq] = value;
+        fallthrough;
+    default:
+        set_key(element->key, value);
+        break;
+    }
+
+    return element;
+}
+
+static void free_element(element_t *element)
+{
+    if (layout == SORT_KEY_POINTER)
+        kfree(element->key);
+    kfree(element);
+}
+
+/* The loops over all the nodes outside of the measurement reschedule every
+ * `SAMPLE_CHUNK` nodes, which keeps the large tests from stalling the CPU */
+#define SAMPLE_CHUNK (1 << 16)
+
+/* The replicas of list_sort() call sites of the kernel, each with an element
+ * laid out like the kernel structure it sorts, the comparator of the call site
+ * and keys distributed like the ones it sees. The elements keep the fields the
+ * comparators read and are padded to about the size of the real structures;
+ * the `seq` added to them is their position in the input, for checking the
+ * stability. The cost model, key and layout parameters don't apply to them. */
+struct sort_site {
+    size_t size;        /* of the element */
+    size_t list_offset; /* of its list_head */
+    size_t seq_offset;  /* of its position in the input */
+    int (*create)(struct list_head *head, int samples, struct xoro_state *rng);
+    list_cmp_func_t raw_cmp; /* the comparator of the call site */
+    list_cmp_func_t cmp;     /* counting the comparisons */
+    llist_cmp_func_t llist_cmp;
+};
+
+/* The site of the running test, NULL for the synthetic cases */
+static const struct sort_site *site;
+
+/* The comparators of the call sites, wrapped for counting their comparisons,
+ * also for the llist engines. Some of them only tell whether `a` goes after
+ * `b`, so every call counts. */
+#define SITE_CMP(raw)                                                         \
+    static int raw##_counted(void *priv, const struct list_head *a,          \
+                             const struct list_head *b)                      \
+    {                                                                         \
+        if (unlikely(a == b))                                                 \
+            return resched_point(priv, true);                                 \
+        return count_site_cmp(priv, raw(priv, a, b));                         \
+    }                                                                         \
+    LLIST_CMP(raw##_counted)
+
+static void *site_alloc(void)
+{
+    return arena_kind ? arena_alloc(&element_arena)
+                      : sample_kmalloc(site->size);
+}
+
+static void *site_entry(const struct list_head *node)
+{
+    return (void *) node - site->list_offset;
+}
+
+/* The software queues of the CPUs and the hardware queues they map to, whose
+ * addresses the plug list is sorted by */
+#define SITE_NR_CTX 8
+#define SITE_NR_HCTX 2
+
+static struct site_queue {
+    u8 pad[L1_CACHE_BYTES];
+} site_ctxs[SITE_NR_CTX], site_hctxs[SITE_NR_HCTX];
+
+/* struct request on the plug list of a task */
+struct site_request {
+    struct site_queue *mq_ctx;
+    struct site_queue *mq_hctx;
+    unsigned int cmd_flags;
+    unsigned int __data_len;
+    u64 __sector;
+    void *bio, *biotail;
+    struct list_head queuelist;
+    int seq;
+    u8 rest[200];
+};
+
+/* plug_rq_cmp() of block/blk-mq.c, formerly plug_ctx_cmp(), which sorted the
+ * plug list in blk_mq_flush_plug_list() by software queue, hardware queue and
+ * sector */
+static int plug_rq_cmp(void *priv, const struct list_head *a,
+                       const struct list_head *b)
+{
+    struct site_request *rqa = container_of(a, struct site_request, queuelist);
+    struct site_request *rqb = container_of(b, struct site_request, queuelist);
+
+    if (rqa->mq_ctx != rqb->mq_ctx)
+        return rqa->mq_ctx > rqb->mq_ctx;
+    if (rqa->mq_hctx != rqb->mq_hctx)
+        return rqa->mq_hctx > rqb->mq_hctx;
+
+    return rqa->__sector > rqb->__sector;
+}
+SITE_CMP(plug_rq_cmp)
+
+/* The requests of a task writing sequential streams of 4K to 128K with some
+ * seeks, and moving between the CPUs every few requests */
+static int create_plug_samples(struct list_head *head,
+                               int samples,
+                               struct xoro_state *rng)
+{
+    u64 next_sector[SITE_NR_CTX];
+    int ctx = 0, burst = 0;
+
+    for (int c = 0; c < SITE_NR_CTX; c++)
+        next_sector[c] = (xoro_next(rng) % (1ULL << 31)) & ~7ULL;
+
+    for (int i = 0; i < samples; i++) {
+        if (!(i % SAMPLE_CHUNK))
+            cond_resched();
+
+        struct site_request *rq = site_alloc();
+        if (!rq)
+            return -ENOMEM;
+
+        if (!burst--) {
+            ctx = xoro_next(rng) % SITE_NR_CTX;
+            burst = xoro_next(rng) % 16;
+        }
+        unsigned int sectors = 8 << (xoro_next(rng) % 6);
+        if (!(xoro_next(rng) % 8))
+            next_sector[ctx] = (xoro_next(rng) % (1ULL << 31)) & ~7ULL;
+
+        rq->mq_ctx = &site_ctxs[ctx];
+        rq->mq_hctx = &site_hctxs[ctx % SITE_NR_HCTX];
+        rq->cmd_flags = 1; /* REQ_OP_WRITE */
+        rq->__data_len = sectors << 9;
+        rq->__sector = next_sector[ctx];
+        rq->seq = i;
+        next_sector[ctx] += sectors;
+        list_add_tail(&rq->queuelist, head);
+    }
+    return 0;
+}
+
+/* struct gfs2_inode on the ordered write list of the log, with its struct inode
+ * as padding */
+struct site_inode {
+    u8 i_inode[600];
+    u64 i_no_formal_ino;
+    u64 i_no_addr;
+    unsigned long i_flags;
+    struct list_head i_ordered;
+    int seq;
+};
+
+/* ip_cmp() of fs/gfs2/log.c, which gfs2_ordered_write() sorts the inodes with
+ * by their disk address before writing their data back */
+static int ip_cmp(void *priv, const struct list_head *a,
+                  const struct list_head *b)
+{
+    struct site_inode *ipa, *ipb;
+
+    ipa = list_entry(a, struct site_inode, i_ordered);
+    ipb = list_entry(b, struct site_inode, i_ordered);
+
+    if (ipa->i_no_addr < ipb->i_no_addr)
+        return -1;
+    if (ipa->i_no_addr > ipb->i_no_addr)
+        return 1;
+    return 0;
+}
+SITE_CMP(ip_cmp)
+
+/* The inodes of the directories of a working set, each allocated in a resource
+ * group of its own, dirtied a few files at a time in the order they were
+ * created, like an untar or a build writing its outputs */
+#define SITE_NR_DIRS 32
+
+static int create_inode_samples(struct list_head *head,
+                                 int samples,
+                                 struct xoro_state *rng)
+{
+    u64 next_addr[SITE_NR_DIRS];
+
+    for (int d = 0; d < SITE_NR_DIRS; d++)
+        next_addr[d] = ((u64) d << 32) + xoro_next(rng) % (1ULL << 24);
+
+    for (int i = 0; i < samples;) {
+        int dir = xoro_next(rng) % SITE_NR_DIRS;
+        int burst = 1 + xoro_next(rng) % 8;
+
+        for (; burst && i < samples; burst--, i++) {
+            if (!(i % SAMPLE_CHUNK))
+                cond_resched();
+
+            struct site_inode *ip = site_alloc();
+            if (!ip)
+                return -ENOMEM;
+
+            /* the dinodes of a directory are close, but not adjacent */
+            next_addr[dir] += 1 + xoro_next(rng) % 4;
+            ip->i_no_addr = next_addr[dir];
+            ip->i_no_formal_ino = i;
+            ip->i_flags = 0;
+            ip->seq = i;
+            list_add_tail(&ip->i_ordered, head);
+        }
+    }
+    return 0;
+}
+
+/* struct xfs_extent_busy of an extent freed by a transaction, with its rbtree
+ * node */
+struct site_extent_busy {
+    unsigned long rb_node[3];
+    struct list_head list;
+    u32 agno;
+    u32 bno;
+    u32 length;
+    unsigned int flags;
+    int seq;
+};
+
+/* xfs_extent_busy_ag_cmp() of fs/xfs/xfs_extent_busy.c, which sorts the busy
+ * extents of a transaction by allocation group and block before clearing
+ * them */
+static int xfs_extent_busy_ag_cmp(void *priv, const struct list_head *l1,
+                                  const struct list_head *l2)
+{
+    struct site_extent_busy *b1 =
+        container_of(l1, struct site_extent_busy, list);
+    struct site_extent_busy *b2 =
+        container_of(l2, struct site_extent_busy, list);
+    s32 diff;
+
+    diff = b1->agno - b2->agno;
+    if (!diff)
+        diff = b1->bno - b2->bno;
+    return diff;
+}
+SITE_CMP(xfs_extent_busy_ag_cmp)
+
+/* The extents of a fragmented file being truncated, in file order: the
+ * allocator keeps a file in one allocation group for a while, leaving small
+ * gaps between its extents, and moves it to another now and then. The extents
+ * of a group never overlap. */
+#define SITE_NR_AGS 16
+#define SITE_AG_BLOCKS (1U << 30)
+
+static int create_extent_samples(struct list_head *head,
+                                 int samples,
+                                 struct xoro_state *rng)
+{
+    u32 next_bno[SITE_NR_AGS];
+    u32 agno = 0;
+
+    for (int ag = 0; ag < SITE_NR_AGS; ag++)
+        next_bno[ag] = xoro_next(rng) % (SITE_AG_BLOCKS / 4);
+
+    for (int i = 0; i < samples; i++) {
+        if (!(i % SAMPLE_CHUNK))
+            cond_resched();
+
+        struct site_extent_busy *busy = site_alloc();
+        if (!busy)
+            return -ENOMEM;
+
+        u32 length = 1 + xoro_next(rng) % 256;
+        if (!(xoro_next(rng) % 16))
+            agno = xoro_next(rng) % SITE_NR_AGS;
+        if (next_bno[agno] + length > SITE_AG_BLOCKS)
+            next_bno[agno] = 0;
+
+        busy->agno = agno;
+        busy->bno = next_bno[agno];
+        busy->length = length;
+        busy->flags = 0;
+        busy->seq = i;
+        next_bno[agno] += length + xoro_next(rng) % 64;
+        list_add_tail(&busy->list, head);
+    }
+    return 0;
+}
+
+#define SORT_SITE(type, list, create, cmp)                                   \
+    {                                                                        \
+        sizeof(type), offsetof(type, list), offsetof(type, seq), create, cmp, \
+            cmp##_counted, cmp##_counted_llist                               \
+    }
+
+/* The call sites of the cases from `SORT_CASE_SITE` on */
+static const struct sort_site sites[] = {
+    SORT_SITE(struct site_request, queuelist, create_plug_samples, plug_rq_cmp),
+    SORT_SITE(struct site_inode, i_ordered, create_inode_samples, ip_cmp),
+    SORT_SITE(struct site_extent_busy, list, create_extent_samples,
+              xfs_extent_busy_ag_cmp),
+};
+
+/* Whether `a` goes after `b`, and the position of `node` in the input, in the
+ * element type of the running test */
+static bool node_greater(const struct list_head *a, const struct list_head *b)
+{
+    if (site)
+        return site->raw_cmp(NULL, a, b) > 0;
+    return list_entry(a, element_t, list)->value >
+           list_entry(b, element_t, list)->value;
+}
+
+static int node_seq(const struct list_head *node)
+{
+    if (site)
+        return *(int *) (site_entry(node) + site->seq_offset);
+    return list_entry(node, element_t, list)->seq;
+}
+
+/* The elements from the arenas are freed with them */
+static void free_list(struct list_head *head)
+{
+    struct list_head *node, *next;
+    size_t i = 0;
+
+    if (arena_kind) {
+        INIT_LIST_HEAD(head);
+        return;
+    }
+    list_for_each_safe (node, next, head) {
+        list_del(node);
+        if (site)
+            kfree(site_entry(node));
+        else
+            free_element(list_entry(node, element_t, list));
+        if (!(++i % SAMPLE_CHUNK))
+            cond_resched();
+    }
+}
+
+/* The recorded keys of `SORT_CASE_TRACE`, which the client writes through
+ * mmap(). The buffer is allocated by the first mmap() and kept until the module
+ * is unloaded, which can't happen while it is still mapped. */
+static u64 *trace_keys;
+static DEFINE_MUTEX(trace_lock);
+
+static int u64_cmp(const void *a, const void *b)
+{
+    return KEY_CMP(*(const u64 *) a, *(const u64 *) b);
+}
+
+/* The index of the first of the `nr` keys in `sorted` which isn't less than
+ * `key` */
+static int lower_bound(const u64 *sorted, int nr, u64 key)
+{
+    int left = 0, right = nr;
+
+    while (left < right) {
+        int middle = (left + right) >> 1;
+        if (sorted[middle] < key)
+            left = middle + 1;
+        else
+            right = middle;
+    }
+    return left;
+}
+
+/* Create the samples from the first `samples` keys of the trace. The keys are
+ * replaced by their ranks among the distinct keys, which keeps their order,
+ * their duplicates and so their runs, so every engine makes the same
+ * comparisons as on the recorded keys. */
+static int create_trace_samples(struct list_head *head, int samples)
+{
+    if (!trace_keys)
+        return -ENODATA;
+    if (samples > MAX_LEN)
+        return -EINVAL;
+
+    u64 *sorted = kvmalloc_array(samples, sizeof(*sorted), GFP_KERNEL);
+    if (!sorted)
+        return -ENOMEM;
+
+    /* the client may still be writing the buffer, so only this copy is
+     * trusted to be sorted */
+    for (int i = 0; i < samples; i++)
+        sorted[i] = READ_ONCE(trace_keys[i]);
+    sort(sorted, samples, sizeof(*sorted), u64_cmp, NULL);
+
+    int distinct = 0;
+    for (int i = 0; i < samples; i++)
+        if (!distinct || sorted[distinct - 1] != sorted[i])
+            sorted[distinct++] = sorted[i];
+
+    for (int i = 0; i < samples; i++) {
+        int rank = lower_bound(sorted, distinct, READ_ONCE(trace_keys[i]));
+        element_t *sample = alloc_element(rank, i);
+        if (!sample) {
+            printk(KERN_ALERT "sort_test: kmalloc failed on `sample`\n");
+            kvfree(sorted);
+            return -ENOMEM;
+        }
+        list_add_tail(&sample->list, head);
+    }
+
+    kvfree(sorted);
+    return 0;
+}
+
+/* The random values of the cases are drawn from `rng` only, so that the same
+ * stream gives the same samples */
 static int create_samples(struct list_head *head,
                            int samples,
-                           int case_id)
+                           int case_id,
+                           struct xoro_state *rng)
 {
-    /* Variables for random values */
+    if (case_id == SORT_CASE_TRACE)
+        return create_trace_samples(head, samples);
+    if (site)
+        return site->create(head, samples, rng);
+
+    /* Variables for random values, which are spread over the whole range of
+     * the large tests */
     int random_section, random_index, random_count;
+    int range = max(samples, MAX_LEN);
     /* The array for saving the duplicate values */
     int dup[4];
     /* defining the place to fill random values */
@@ -71,12 +1128,12 @@ static int create_samples(struct list_head *head,
     case 1: /* Random 3 elements */
         random_count = 3;
         random_section = samples / 3;
-        random_index = next() % random_section;
+        random_index = xoro_next(rng) % random_section;
         break;
     case 3: /* Random 1% elements */
         random_count = samples / 100;
         random_section = 100;
-        random_index = next() % random_section;
+        random_index = xoro_next(rng) % random_section;
         break;
     case 4: /* Duplicate */
         for (int i = 0 ; i < 4 ; i++)
@@ -89,21 +1146,18 @@ static int create_samples(struct list_head *head,
     int cnt = 0;
     /* Start to create the samples for the testing list */
     for (int i = 0; i < samples; i++, cnt++) {
-        element_t *sample = kmalloc(sizeof(element_t), GFP_KERNEL);
-        if (!samples) {
-            printk(KERN_ALERT "sort_test: kmalloc failed on `sample`\n");
-            return -ENOMEM; // Return error if allocation fails
-        }
-
         int value;
+
+        if (!(i % SAMPLE_CHUNK))
+            cond_resched();
         switch (case_id) {
         case 0: /* Worst case of merge sort */
             value = i;
             break;
         case 1: /* Random 3 elements */
             if (cnt == random_index && random_count) {
-                value = next() % MAX_LEN;
-                random_index = next() % random_section;
+                value = xoro_next(rng) % range;
+                random_index = xoro_next(rng) % random_section;
                 cnt = -1;
                 random_count--;
             } else
@@ -113,28 +1167,31 @@ static int create_samples(struct list_head *head,
             if (i < samples - 10)
                 value = i;
             else {
-                value = next() % MAX_LEN;
+                value = xoro_next(rng) % range;
             }
             break;
         case 3: /* Random 1% elements */
             if (cnt == random_index && random_count) {
-                value = next() % MAX_LEN;
-                random_index = next() % random_section;
+                value = xoro_next(rng) % range;
+                random_index = xoro_next(rng) % random_section;
                 cnt = -1;
                 random_count--;
             } else
                 value = i;
             break;
         case 4: /* Duplicate */
-            value = dup[next() % 4];
+            value = dup[xoro_next(rng) % 4];
             break;
         default: /* Random elements */
-            value = next() % MAX_LEN;
+            value = xoro_next(rng) % range;
             break;
         }
 
-        sample->value = value;
-        sample->seq = i;
+        element_t *sample = alloc_element(value, i);
+        if (!sample) {
+            printk(KERN_ALERT "sort_test: kmalloc failed on `sample`\n");
+            return -ENOMEM; // Return error if allocation fails
+        }
         list_add_tail(&sample->list, head);
     }
 
@@ -145,21 +1202,94 @@ static int create_samples(struct list_head *head,
     return 0;
 }
 
+/* log2(x) for x >= 1 in fixed point with `SORT_TEST_NH_SHIFT` fractional bits,
+ * computing the fraction bit by bit by squaring the mantissa */
+static u64 log2_fixed(u64 x)
+{
+    int exp = ilog2(x);
+    u64 res = (u64) exp << SORT_TEST_NH_SHIFT;
+    /* the mantissa in [1, 2) with 31 fractional bits */
+    u64 m = exp > 31 ? x >> (exp - 31) : x << (31 - exp);
+
+    for (int i = 1; i <= SORT_TEST_NH_SHIFT; i++) {
+        m = (m * m) >> 31;
+        if (m >= (1ULL << 32)) {
+            m >>= 1;
+            res |= 1ULL << (SORT_TEST_NH_SHIFT - i);
+        }
+    }
+
+    return res;
+}
+
+/* The run profile of the input, splitting it into the same natural runs as
+ * find_run() does (strictly descending or non-descending), and the product
+ * of the number of nodes `n` and the run-length entropy `H`:
+ *
+ *   n * H = sum(r * log2(n / r)) = n * log2(n) - sum(r * log2(r))
+ *
+ * which is in fixed point with `SORT_TEST_NH_SHIFT` fractional bits.
+ */
+static void run_profile(struct list_head *head, size_t *runs, u64 *nh)
+{
+    size_t n = 0, len = 0;
+    u64 sum = 0;
+    int dir = 0; /* -1 -> descending ; 1 -> non-descending ; 0 -> unknown */
+    struct list_head *entry, *prev = NULL;
+
+    *runs = 0;
+    list_for_each (entry, head) {
+        /* the interrupts are disabled here unless the sort is preemptible,
+         * which a large test is */
+        if (!(++n % SAMPLE_CHUNK) && preempt_mode)
+            cond_resched();
+        if (prev && !dir) {
+            dir = node_greater(prev, entry) ? -1 : 1;
+        } else if (prev && (dir < 0) != node_greater(prev, entry)) {
+            /* the run ends, a new one starts from `entry` */
+            sum += len * log2_fixed(len);
+            (*runs)++;
+            len = 0;
+            dir = 0;
+        }
+        len++;
+        prev = entry;
+    }
+
+    if (!n) {
+        *nh = 0;
+        return;
+    }
+    sum += len * log2_fixed(len);
+    (*runs)++;
+    *nh = n * log2_fixed(n) - sum;
+}
+
 static int copy_list(struct list_head *from, struct list_head *to)
 {
     if (list_empty(from))
         return 0;
 
+    if (site) {
+        struct list_head *node;
+        list_for_each (node, from) {
+            void *copy = site_alloc();
+            if (!copy)
+                return -ENOMEM;
+            memcpy(copy, site_entry(node), site->size);
+            list_add_tail(copy + site->list_offset, to);
+        }
+        return 0;
+    }
+
     element_t *entry;
     list_for_each_entry (entry, from, list) {
-        element_t *copy = kmalloc(sizeof(element_t), GFP_KERNEL);
+        element_t *copy = alloc_element(entry->value, entry->seq);
         if (!copy) {
             printk(KERN_ALERT "sort_test: kmalloc failed on `sample`\n");
             return -ENOMEM; // Return error if allocation fails
         }
 
-        copy->value = entry->value;
-        copy->seq = entry->seq;
         list_add_tail(&copy->list, to);
     }
 
@@ -172,20 +1302,23 @@ static bool check_list(struct list_head *head, int count)
     if (list_empty(head))
         return 0 == count;
 
-    element_t *entry, *safe;
+    struct list_head *entry, *safe;
     size_t ctr = 0;
-    list_for_each_entry_safe (entry, safe, head, list) {
+    list_for_each_safe (entry, safe, head) {
         ctr++;
     }
 
     int unstable = 0;
-    list_for_each_entry_safe (entry, safe, head, list) {
-        if (entry->list.next != head) {
-            if (entry->value > safe->value) {
+    ctr = 0;
+    list_for_each_safe (entry, safe, head) {
+        if (!(++ctr % SAMPLE_CHUNK))
+            cond_resched();
+        if (entry->next != head) {
+            if (node_greater(entry, safe)) {
                 printk(KERN_ALERT "\nERROR: Wrong order\n");
                 return false;
             }
-            if (entry->value == safe->value && entry->seq > safe->seq)
+            if (!node_greater(safe, entry) && node_seq(entry) > node_seq(safe))
                 unstable++;
         }
     }
@@ -203,6 +1336,94 @@ static bool check_list(struct list_head *head, int count)
     return true;
 }
 
+/* The llist engines sort the list as the elements chained by the `next` of
+ * their list_heads, which is the layout of struct llist_node */
+static struct llist_node *test_llist_sort(void *priv,
+                                          struct llist_node *list,
+                                          list_cmp_func_t cmp,
+                                          llist_cmp_func_t llist_cmp)
+{
+    return llist_sort(priv, list, llist_cmp);
+}
+
+static struct llist_node *test_llist_timsort_b_gallop(void *priv,
+                                                      struct llist_node *list,
+                                                      list_cmp_func_t cmp,
+                                                      llist_cmp_func_t llist_cmp)
+{
+    return llist_timsort_b_gallop(priv, list, llist_cmp);
+}
+
+static struct llist_node *test_llist_shiverssort(void *priv,
+                                                 struct llist_node *list,
+                                                 list_cmp_func_t cmp,
+                                                 llist_cmp_func_t llist_cmp)
+{
+    return llist_shiverssort(priv, list, llist_cmp);
+}
+
+/* The baselines of the llist engines: converting the llist to a list_head
+ * list in place, sorting it with `sort` and terminating it again. The llist
+ * engines have no low-cardinality fallback, so neither do these. */
+static struct llist_node *llist_via(void *priv,
+                                    struct llist_node *list,
+                                    list_cmp_func_t cmp,
+                                    test_func_t sort)
+{
+    LIST_HEAD(head);
+    struct list_head *prev = &head;
+    u8 count = 0;
+
+    for (; list; list = list->next) {
+        struct list_head *node = (struct list_head *) list;
+
+        prev->next = node;
+        node->prev = prev;
+        prev = node;
+        /* no comparisons here, call back to cond_resched() */
+        if (unlikely(!++count))
+            cmp(priv, node, node);
+    }
+    prev->next = &head;
+    head.prev = prev;
+
+    sort(priv, &head, cmp);
+    if (list_empty(&head))
+        return NULL;
+    head.prev->next = NULL;
+    return (struct llist_node *) head.next;
+}
+
+#define LLIST_VIA(sort)                                                       \
+    static struct llist_node *llist_via_##sort(void *priv,                   \
+                                               struct llist_node *list,      \
+                                               list_cmp_func_t cmp,          \
+                                               llist_cmp_func_t llist_cmp)   \
+    {                                                                         \
+        return llist_via(priv, list, cmp, sort);                              \
+    }
+
+LLIST_VIA(list_sort)
+LLIST_VIA(timsort_b_gallop)
+LLIST_VIA(shiverssort)
+
+/* list_sort_tail() of the nodes after the sorted prefix. The walk to its end
+ * is part of the measurement, but a real caller would know where it
+ * appended. */
+static void tail_listsort(void *priv,
+                          struct list_head *head,
+                          list_cmp_func_t cmp)
+{
+    struct list_head *last = head->prev;
+
+    for (size_t i = 0; i < tail_len;) {
+        last = last->prev;
+        if (unlikely(!(++i & 0xff)))
+            cmp(priv, last, last);
+    }
+    list_sort_tail(priv, head, last, cmp, list_sort);
+}
+
 test_t tests[] = {
     {.name = "listsort", .impl = list_sort},
     {.name = "timsort_merge", .impl = timsort_merge},
@@ -212,121 +1433,833 @@ test_t tests[] = {
     {.name = "timsort_b_gallop", .impl = timsort_b_gallop},
     {.name = "adaptive_shiverssort", .impl = shiverssort},
     {.name = "adaptive_shiverssort_merge", .impl = shiverssort_merge},
+    {.name = "lowcard", .impl = lowcard_sort},
+    {.name = "timsort_sliced", .impl = timsort_sliced},
+    {.name = "llist_sort", .llist_impl = test_llist_sort},
+    {.name = "llist_timsort_b_gallop", .llist_impl = test_llist_timsort_b_gallop},
+    {.name = "llist_shiverssort", .llist_impl = test_llist_shiverssort},
+    {.name = "llist_via_listsort", .llist_impl = llist_via_list_sort},
+    {.name = "llist_via_timsort_b_gallop",
+     .llist_impl = llist_via_timsort_b_gallop,
+     .no_lowcard = true},
+    {.name = "llist_via_shiverssort",
+     .llist_impl = llist_via_shiverssort,
+     .no_lowcard = true},
+    {.name = "tail_listsort", .impl = tail_listsort, .sorted_prefix = true},
+    /* the baselines of tail_listsort, sorting the whole of the same input
+     * without the fallback list_sort() doesn't have */
+    {.name = "tail_full_listsort", .impl = list_sort, .sorted_prefix = true},
+    {.name = "tail_full_timsort_b_gallop",
+     .impl = timsort_b_gallop,
+     .sorted_prefix = true,
+     .no_lowcard = true},
     {NULL, NULL},
 };
+/* The running test, set from the job of a read() or of the job thread under
+ * `test_lock` */
 test_t test;
+/* The compare function of the llist engines, of the same kind as the one of
+ * the running test */
+static llist_cmp_func_t llist_cmp;
 
-static ktime_t kt_sort;
 int nodes, case_id;
+/* The seed of the samples and the iteration picking the stream of the seed,
+ * see xoro_stream() */
+static u64 sample_seed;
+static unsigned int sample_iteration;
+static DEFINE_MUTEX(test_lock);
+
+/* The state of an open file of the device: the test written to it, and the
+ * jobs it submitted, see `SORT_TEST_IOC_SUBMIT` */
+struct sort_file {
+    struct sort_test_job params;
+    /* the finished jobs, and the jobs from the submission to the fetch of
+     * their results, under `job_lock` */
+    struct list_head done;
+    unsigned int jobs;
+    wait_queue_head_t wait;
+};
+
+/* A job in the queue of the job thread, or in the `done` list of its file */
+struct sort_job {
+    struct list_head list;
+    struct sort_file *owner;
+    struct sort_test_job job;
+    struct sort_test_job_result result;
+};
+
+static void sort_file_cancel(struct sort_file *sf);
 
 static int sort_test_open(struct inode *inode, struct file *file)
 {
-    nodes = 0;
-    case_id = 0;
-    
+    struct sort_file *sf = kzalloc(sizeof(*sf), GFP_KERNEL);
+
+    if (!sf)
+        return -ENOMEM;
+    INIT_LIST_HEAD(&sf->done);
+    init_waitqueue_head(&sf->wait);
+    file->private_data = sf;
+
     // printk(KERN_INFO "You have opened the `sort_test` device driver !");
     return 0;
 }
 
 static int sort_test_release(struct inode *inode, struct file *file)
 {
-    nodes = 0;
-    case_id = 0;
+    struct sort_file *sf = file->private_data;
+
+    sort_file_cancel(sf);
+    kfree(sf);
 
     // printk(KERN_INFO "You have closed the `sort_test` device driver !");
     return 0;
 }
 
-/* When a process attempts to read this opened dev file, 
- * starting the test of the linked-list.
- */
-static ssize_t sort_test_read(struct file *file, char __user *buf, size_t size, loff_t *offset)
+/* Terminate the list of `head` as an llist of its elements, returning the
+ * first one */
+static struct llist_node *llist_detach(struct list_head *head)
+{
+    struct llist_node *list;
+
+    if (list_empty(head))
+        return NULL;
+    list = (struct llist_node *) head->next;
+    head->prev->next = NULL;
+    INIT_LIST_HEAD(head);
+    return list;
+}
+
+/* Rebuild the list of `head` from the llist sorted by an llist engine, outside
+ * of the measurement */
+static void llist_attach(struct list_head *head, struct llist_node *list)
+{
+    struct list_head *prev = head;
+    size_t i = 0;
+
+    for (; list; list = list->next) {
+        struct list_head *node = (struct list_head *) list;
+
+        prev->next = node;
+        node->prev = prev;
+        prev = node;
+        /* the warmup runs with the interrupts disabled */
+        if (preempt_mode && !(++i % SAMPLE_CHUNK))
+            cond_resched();
+    }
+    prev->next = head;
+    head->prev = prev;
+}
+
+/* Sort `head` with the running test, outside of the measurement */
+static void test_sort(struct sort_run *run,
+                      struct list_head *head,
+                      list_cmp_func_t cmp)
+{
+    if (test.llist_impl)
+        llist_attach(head, test.llist_impl(run, llist_detach(head), cmp,
+                                           llist_cmp));
+    else
+        test.impl(run, head, cmp);
+}
+
+/* The order of check_list(), for sorting the prefix of the samples */
+static int prefix_cmp(void *priv, const struct list_head *a,
+                      const struct list_head *b)
+{
+    if (unlikely(a == b)) {
+        cond_resched();
+        return 0;
+    }
+    return node_greater(a, b);
+}
+
+/* Sort all but the last `tail_len` nodes of `head`, which is not measured */
+static void sort_prefix(struct list_head *head)
+{
+    struct list_head prefix, *last = head;
+    size_t sorted = nodes - tail_len;
+
+    if (!sorted)
+        return;
+    for (size_t i = 0; i < sorted; i++) {
+        last = last->next;
+        if (!((i + 1) % SAMPLE_CHUNK))
+            cond_resched();
+    }
+    list_cut_position(&prefix, head, last);
+    list_sort(NULL, &prefix, prefix_cmp);
+    list_splice(&prefix, head);
+}
+
+/* Create the samples from the `stream`-th stream of the iteration, and their
+ * warmup copy. A large test doesn't fit in the caches anyway, so it isn't
+ * warmed up. The samples of a test with a sorted prefix are sorted up to their
+ * last `tail_len`. */
+static int prepare_samples(struct list_head *head,
+                           struct list_head *warmup,
+                           unsigned int stream)
+{
+    struct xoro_state rng;
+    int ret;
+
+    xoro_stream(&rng, sample_seed, sample_iteration, stream);
+    ret = create_samples(head, nodes, case_id, &rng);
+    if (ret)
+        return ret;
+    if (test.sorted_prefix)
+        sort_prefix(head);
+    if (large_mode)
+        return 0;
+
+    return copy_list(head, warmup);
+}
+
+/* A counter of the dTLB load misses of the current task in the kernel, see
+ * `count_dtlb` */
+static struct perf_event *dtlb_counter(void)
+{
+    struct perf_event_attr attr = {
+        .type = PERF_TYPE_HW_CACHE,
+        .size = sizeof(attr),
+        .config = PERF_COUNT_HW_CACHE_DTLB |
+                  (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+        .pinned = 1,
+        .exclude_user = 1,
+    };
+
+    return perf_event_create_kernel_counter(&attr, -1, current, NULL, NULL);
+}
+
+static u64 dtlb_read(struct perf_event *event)
+{
+    u64 enabled, running;
+
+    return perf_event_read_value(event, &enabled, &running);
+}
+
+/* Sort `warmup` unless it is NULL, then make the measured sort of `head`,
+ * filling the results of `run`. Fails only if the dTLB misses can't be
+ * counted. */
+static int sort_measured(struct sort_run *run,
+                         struct list_head *head,
+                         struct list_head *warmup,
+                         list_cmp_func_t cmp)
+{
+    struct perf_event *dtlb = NULL;
+    u64 misses = 0;
+
+    if (dtlb_mode) {
+        dtlb = dtlb_counter();
+        if (IS_ERR(dtlb))
+            return PTR_ERR(dtlb);
+    }
+
+    if (!preempt_mode) {
+        local_irq_disable(); /* disable interrupt */
+        get_cpu(); /* disable preemption */
+    }
+
+    /* Warmup */
+    if (warmup && !list_empty(warmup))
+        test_sort(run, warmup, cmp);
+
+    /* The run profile of the input, which isn't part of the measurement */
+    run_profile(head, &run->runs, &run->nh);
+    /* an llist engine is given an llist, see test_llist_sort() */
+    struct llist_node *list = test.llist_impl ? llist_detach(head) : NULL;
+
+    run->count = 0;
+    if (run->phases) {
+        memset(&sort_stats, 0, sizeof(sort_stats));
+        sort_merge_cost = 0;
+    }
+    run->resched_max_gap = run->resched_yield = 0;
+    run->resched_points = 0;
+    run->large_cmps = 0;
+    run->cpu = raw_smp_processor_id();
+    /* the counter is read outside of the measured time */
+    if (dtlb)
+        misses = dtlb_read(dtlb);
+    run->duration = ktime_get();
+    run->resched_last = local_clock();
+    /* Start the sortings */
+    if (test.llist_impl)
+        list = test.llist_impl(run, list, cmp, llist_cmp);
+    else
+        test.impl(run, head, cmp);
+    resched_point(run, false);
+    run->duration = ktime_sub(ktime_get(), run->duration);
+    run->dtlb_misses = dtlb ? dtlb_read(dtlb) - misses : 0;
+
+    if (!preempt_mode) {
+        local_irq_enable();
+        put_cpu();
+    }
+    if (test.llist_impl)
+        llist_attach(head, list);
+    if (dtlb)
+        perf_event_release_kernel(dtlb);
+    return 0;
+}
+
+/* The measured sort run by work_on_cpu() on a CPU of `sort_node` */
+struct sort_work {
+    struct sort_run *run;
+    struct list_head *head, *warmup;
+    list_cmp_func_t cmp;
+};
+
+static long sort_measured_work(void *data)
 {
-    local_irq_disable(); /* disable interrupt */
-    get_cpu(); /* disable preemption */
+    struct sort_work *work = data;
+
+    return sort_measured(work->run, work->head, work->warmup, work->cmp);
+}
+
+/* The concurrent mode runs the test on every online CPU at once, each CPU
+ * sorting a list of its own from the stream of its number, in a kthread bound
+ * to it. The sorts start together from a barrier once every CPU has created
+ * its samples and warmed up. They are preemptible, the other tasks of a CPU
+ * having nowhere else to go, and the phases and the merge cost aren't counted
+ * as they would be shared by all the CPUs, see `sort_stats_on`. */
+static bool concurrent;
+module_param(concurrent, bool, 0644);
+MODULE_PARM_DESC(concurrent,
+                 "Sort on every online CPU at once, each with a list of its "
+                 "own (not with an arena or cmp_cost=3)");
+
+/* The sort of one CPU in the concurrent mode */
+struct sort_cpu {
+    struct sort_run run;
+    struct task_struct *task;
+    list_cmp_func_t cmp;
+    unsigned int cpu;
+    int ret;
+    ktime_t end; /* when the sort finished */
+};
+
+static atomic_t concurrent_waiting, concurrent_running;
+static DECLARE_COMPLETION(concurrent_start);
+static DECLARE_COMPLETION(concurrent_done);
+static ktime_t concurrent_begin;
 
-    size_t count = 0;
+/* The results of the last concurrent test, for
+ * `/sys/kernel/debug/sort_test/cpus` */
+static struct sort_cpu *last_cpus;
+static unsigned int last_nr_cpus;
+static int last_nodes;
+static ktime_t last_wall;
+static DEFINE_MUTEX(cpus_lock);
+
+static int concurrent_thread(void *data)
+{
+    struct sort_cpu *sc = data;
     struct list_head sample_head, warmup_head;
 
-    /* Initialize the sample linked-list */
     INIT_LIST_HEAD(&sample_head);
-    int chk = create_samples(&sample_head, nodes, case_id);
-    if (chk)
-        return chk;
+    INIT_LIST_HEAD(&warmup_head);
+    sc->ret = prepare_samples(&sample_head, &warmup_head, sc->cpu);
+    if (!sc->ret && !list_empty(&warmup_head))
+        test_sort(&sc->run, &warmup_head, sc->cmp);
+
+    /* The last CPU to be ready starts them all */
+    if (atomic_dec_and_test(&concurrent_waiting)) {
+        concurrent_begin = ktime_get();
+        complete_all(&concurrent_start);
+    } else {
+        wait_for_completion(&concurrent_start);
+    }
+
+    if (!sc->ret)
+        sc->ret = sort_measured(&sc->run, &sample_head, NULL, sc->cmp);
+    if (!sc->ret) {
+        sc->end = ktime_get();
+        if (!check_list(&sample_head, sc->run.count))
+            sc->ret = -EILSEQ;
+    }
+
+    free_list(&sample_head);
+    free_list(&warmup_head);
+    if (atomic_dec_and_test(&concurrent_running))
+        complete(&concurrent_done);
+    return 0;
+}
+
+/* Run the test on every online CPU, returning the sorts in `*res` */
+static int sort_concurrent(list_cmp_func_t cmp,
+                           struct sort_cpu **res,
+                           unsigned int *nr_cpus)
+{
+    struct sort_cpu *cpus;
+    unsigned int cpu, nr = 0;
+    int ret = 0;
+
+    *res = NULL;
+    cpus_read_lock();
+    cpus = kcalloc(num_online_cpus(), sizeof(*cpus), GFP_KERNEL);
+    if (!cpus) {
+        cpus_read_unlock();
+        return -ENOMEM;
+    }
+    for_each_online_cpu (cpu) {
+        struct sort_cpu *sc = &cpus[nr];
+        struct task_struct *task =
+            kthread_create(concurrent_thread, sc, DEVICE_NAME "/%u", cpu);
+
+        if (IS_ERR(task)) {
+            ret = PTR_ERR(task);
+            break;
+        }
+        /* kthread_stop() reaps it after it returned by itself */
+        get_task_struct(task);
+        kthread_bind(task, cpu);
+        sc->task = task;
+        sc->cmp = cmp;
+        sc->cpu = cpu;
+        nr++;
+    }
+    cpus_read_unlock();
+
+    if (!ret) {
+        atomic_set(&concurrent_waiting, nr);
+        atomic_set(&concurrent_running, nr);
+        reinit_completion(&concurrent_start);
+        reinit_completion(&concurrent_done);
+        for (unsigned int i = 0; i < nr; i++)
+            wake_up_process(cpus[i].task);
+        wait_for_completion(&concurrent_done);
+    }
+
+    /* Reap the threads; the ones which weren't woken exit without running */
+    for (unsigned int i = 0; i < nr; i++) {
+        kthread_stop(cpus[i].task);
+        put_task_struct(cpus[i].task);
+        if (!ret)
+            ret = cpus[i].ret;
+    }
+    /* the counters of the engines are garbage after sorting on all CPUs */
+    memset(&sort_stats, 0, sizeof(sort_stats));
+    sort_merge_cost = 0;
+
+    *res = cpus;
+    *nr_cpus = nr;
+    return ret;
+}
+
+/* Format the result line of `run`, see `sort_test_ioctl.h` */
+static void format_run(char *line,
+                       size_t size,
+                       const struct sort_run *run,
+                       unsigned int nr_cpus)
+{
+    snprintf(line, size, "%llu %lu %lu %llu %llu %llu %lu %llu %u %u %llu",
+             (unsigned long long int) run->duration, run->count, run->runs,
+             run->nh, run->phases ? sort_merge_cost : 0, run->resched_max_gap,
+             run->resched_points, run->resched_yield, nr_cpus, run->cpu,
+             run->dtlb_misses);
+}
+
+/* The test of the concurrent mode, whose result is of the slowest sort, which
+ * the others overlapped */
+static int sort_test_run_concurrent(char *line,
+                                    size_t size,
+                                    list_cmp_func_t cmp)
+{
+    struct sort_cpu *cpus;
+    unsigned int nr_cpus;
+    int ret = sort_concurrent(cmp, &cpus, &nr_cpus);
+
+    if (ret) {
+        kfree(cpus);
+        return ret;
+    }
+
+    struct sort_cpu *slowest = &cpus[0];
+    ktime_t end = 0;
+    for (unsigned int i = 0; i < nr_cpus; i++) {
+        if (cpus[i].run.duration > slowest->run.duration)
+            slowest = &cpus[i];
+        end = max(end, cpus[i].end);
+    }
+    format_run(line, size, &slowest->run, nr_cpus);
+
+    mutex_lock(&cpus_lock);
+    kfree(last_cpus);
+    last_cpus = cpus;
+    last_nr_cpus = nr_cpus;
+    last_nodes = nodes;
+    last_wall = ktime_sub(end, concurrent_begin);
+    mutex_unlock(&cpus_lock);
+
+    return 0;
+}
+
+/* Latch the parameters the elements are laid out by, under `test_lock`.
+ * Returns whether they are valid. */
+static bool latch_layout(void)
+{
+    cmp_model = READ_ONCE(cmp_cost);
+    key_bytes = READ_ONCE(cmp_key_bytes);
+    payload_bytes = READ_ONCE(elem_payload);
+    layout = READ_ONCE(key_layout);
+    key_kind = READ_ONCE(key_type);
+    arena_kind = READ_ONCE(arena);
+
+    if (cmp_model < 0 || cmp_model >= SORT_CMP_NR ||
+        (cmp_model == SORT_CMP_MEMCMP && key_bytes < 4))
+        return false;
+    /* the memcmp() and the indirect cost models have keys of their own */
+    if (key_kind < 0 || key_kind >= SORT_KEY_TYPE_NR ||
+        (key_kind != SORT_KEY_INT && cmp_model >= SORT_CMP_MEMCMP))
+        return false;
+    /* a key behind the payload is only on another line if the payload spans
+     * a whole line */
+    if (layout < 0 || layout >= SORT_KEY_NR || payload_bytes > 4096 ||
+        (layout == SORT_KEY_OTHER_LINE && payload_bytes < L1_CACHE_BYTES))
+        return false;
+    return arena_kind >= 0 && arena_kind < SORT_ARENA_NR;
+}
+
+/* Run the test of `job` under `test_lock`, formatting its result line into
+ * `line`. Returns -EINVAL for an invalid test, and -EILSEQ if the list isn't
+ * sorted. */
+static int sort_test_run(const struct sort_test_job *job,
+                         char *line,
+                         size_t size)
+{
+    /* the tests of more than `MAX_LEN` nodes are checked for an arena below,
+     * and the cases are the synthetic ones, the trace and the call sites */
+    if (job->sort_id >= ARRAY_SIZE(tests) - 1 || job->nodes < MIN_LEN ||
+        job->nodes > LARGE_MAX_LEN ||
+        job->case_id >= SORT_CASE_SITE + ARRAY_SIZE(sites))
+        return -EINVAL;
+    nodes = job->nodes;
+    case_id = job->case_id;
+    test = tests[job->sort_id];
+    sample_seed = job->seed;
+    sample_iteration = job->iteration;
+
+    /* Pick the comparator before disabling interrupts, the key table may come
+     * from vmalloc() */
+    if (!latch_layout())
+        return -EINVAL;
+    preempt_mode = READ_ONCE(preemptible);
+    sample_nid = READ_ONCE(sample_node);
+    dtlb_mode = READ_ONCE(count_dtlb);
+    lowcard_fallback = READ_ONCE(lowcard_param) && !test.no_lowcard;
+    tail_len = min_t(size_t, READ_ONCE(tail_nodes), nodes);
+    bool concurrent_mode = READ_ONCE(concurrent);
+    int sort_nid = READ_ONCE(sort_node);
+    unsigned int sort_cpu = nr_cpu_ids;
+    large_mode = nodes > MAX_LEN;
+    site = case_id >= SORT_CASE_SITE &&
+                   case_id < SORT_CASE_SITE + ARRAY_SIZE(sites)
+               ? &sites[case_id - SORT_CASE_SITE]
+               : NULL;
+    if (large_mode && (!arena_kind || nodes > LARGE_MAX_LEN))
+        return -EINVAL;
+    /* the sparse arena has a page of its own for each object, whose page
+     * tables would take gigabytes in a large test */
+    if (arena_kind == SORT_ARENA_SPARSE &&
+        (large_mode || (site ? site->size : element_size()) > PAGE_SIZE ||
+         (layout == SORT_KEY_POINTER && !site && key_size() > PAGE_SIZE)))
+        return -EINVAL;
+    if (sample_nid != NUMA_NO_NODE && !node_valid(sample_nid))
+        return -EINVAL;
+    /* the sort moves to the first online CPU of its node */
+    if (sort_nid != NUMA_NO_NODE && !concurrent_mode) {
+        if (!node_valid(sort_nid))
+            return -EINVAL;
+        sort_cpu = cpumask_any_and(cpumask_of_node(sort_nid), cpu_online_mask);
+        if (sort_cpu >= nr_cpu_ids)
+            return -EINVAL;
+    }
+    /* the arenas and the key table are of a single list */
+    if (concurrent_mode &&
+        (arena_kind || (cmp_model == SORT_CMP_INDIRECT && !site)))
+        return -EINVAL;
+    /* the sort of a large test takes seconds, which has to be preemptible */
+    if (large_mode || concurrent_mode || dtlb_mode)
+        preempt_mode = true;
+    list_cmp_func_t cmp = cmp_model == SORT_CMP_INT ? key_cmps[key_kind]
+                                                    : cmp_funcs[cmp_model];
+    llist_cmp = cmp_model == SORT_CMP_INT ? llist_key_cmps[key_kind]
+                                          : llist_cmp_funcs[cmp_model];
+    if (site) {
+        cmp = site->cmp;
+        llist_cmp = site->llist_cmp;
+    }
+
+    struct sort_run run = {.phases = true};
+    int ret;
+
+    sort_stats_on = !concurrent_mode;
+    if (concurrent_mode)
+        return sort_test_run_concurrent(line, size, cmp);
+
+    if (cmp_model == SORT_CMP_INDIRECT && !site) {
+        key_table = kvmalloc_node(array_size(nodes, sizeof(*key_table)),
+                                  GFP_KERNEL, sample_nid);
+        if (!key_table)
+            return -ENOMEM;
+    }
 
-    /* Initialize the warmup linked-list */
+    struct list_head sample_head, warmup_head;
+
+    /* Initialize the sample linked-list */
+    INIT_LIST_HEAD(&sample_head);
     INIT_LIST_HEAD(&warmup_head);
-    chk = copy_list(&sample_head, &warmup_head);
-    if (chk)
-        return chk;
+    if (arena_kind) {
+        /* the samples and their warmup copy */
+        size_t objects = large_mode ? nodes : 2 * (size_t) nodes;
 
-    /* Warmup */
-    test.impl(&count, &warmup_head, list_cmp);
+        ret = arena_init(&element_arena, objects,
+                         site ? site->size : element_size());
+        if (!ret && layout == SORT_KEY_POINTER && !site)
+            ret = arena_init(&key_arena, objects, key_size());
+        if (ret)
+            goto out;
+    }
+    ret = prepare_samples(&sample_head, &warmup_head, 0);
+    if (ret)
+        goto out;
 
-    count = 0;
-    kt_sort = ktime_get();
-    /* Start the sortings */
-    test.impl(&count, &sample_head, list_cmp);
-    kt_sort = ktime_sub(ktime_get(), kt_sort);
-    ktime_to_us(kt_sort);
+    if (sort_cpu < nr_cpu_ids) {
+        struct sort_work work = {&run, &sample_head, &warmup_head, cmp};
+
+        ret = work_on_cpu(sort_cpu, sort_measured_work, &work);
+    } else {
+        ret = sort_measured(&run, &sample_head, &warmup_head, cmp);
+    }
+    if (ret)
+        goto out;
 
     /* Check if the list is sorted */
-    if (!check_list(&sample_head, count)) {
+    if (!check_list(&sample_head, run.count)) {
         printk(KERN_ALERT "The list isn't sorted in the correct order\n");
-        return 0;
+        ret = -EILSEQ;
+        goto out;
     }
 
-    /* Delete the list and free the current `element_t` structure */
-    element_t *iterator, *next;
-    list_for_each_entry_safe (iterator, next, &sample_head, list) {
-        list_del(&iterator->list);
-        kfree(iterator);
+    format_run(line, size, &run, 1);
+
+out:
+    /* Delete the lists and free the current `element_t` structures */
+    free_list(&sample_head);
+    free_list(&warmup_head);
+    arena_free(&element_arena);
+    arena_free(&key_arena);
+    kvfree(key_table);
+    key_table = NULL;
+
+    return ret;
+}
+
+/* When a process attempts to read this opened dev file, 
+ * starting the test of the linked-list written to it.
+ */
+static ssize_t sort_test_read(struct file *file, char __user *buf, size_t size, loff_t *offset)
+{
+    struct sort_file *sf = file->private_data;
+    char line[SORT_TEST_LINE] = "";
+    int ret;
+
+    mutex_lock(&test_lock);
+    ret = sort_test_run(&sf->params, line, sizeof(line));
+    mutex_unlock(&test_lock);
+    /* an unsorted list reads nothing */
+    if (ret)
+        return ret == -EILSEQ ? 0 : ret;
+
+    if (copy_to_user(buf, line, min(size, sizeof(line)))) {
+        printk(KERN_ALERT "Failed to copy data to user\n");
+        return -EFAULT;
     }
+    return size;
+}
+
+/* The jobs run by a kthread bound to `job_cpu`, so that the CPU measuring the
+ * sorts doesn't run the client, which waits for them with poll() */
+static int job_cpu = -1;
+module_param(job_cpu, int, 0444);
+MODULE_PARM_DESC(job_cpu,
+                 "CPU running the jobs, best one isolated from the scheduler "
+                 "(-1 for the last online CPU, at load time)");
 
-    list_for_each_entry_safe (iterator, next, &warmup_head, list) {
-        list_del(&iterator->list);
-        kfree(iterator);
+static LIST_HEAD(job_queue);
+static DEFINE_SPINLOCK(job_lock);
+static DECLARE_WAIT_QUEUE_HEAD(job_wait);
+static struct task_struct *job_task;
+static struct sort_job *job_running;
+
+static int job_thread(void *data)
+{
+    while (!kthread_should_stop()) {
+        struct sort_job *job;
+
+        wait_event_interruptible(job_wait, kthread_should_stop() ||
+                                               !list_empty(&job_queue));
+        spin_lock(&job_lock);
+        job = list_first_entry_or_null(&job_queue, struct sort_job, list);
+        if (job)
+            list_del(&job->list);
+        job_running = job;
+        spin_unlock(&job_lock);
+        if (!job)
+            continue;
+
+        mutex_lock(&test_lock);
+        job->result.status = sort_test_run(&job->job, job->result.line,
+                                           sizeof(job->result.line));
+        job->result.phases = sort_stats;
+        mutex_unlock(&test_lock);
+
+        /* the file may be released as soon as its job isn't running */
+        spin_lock(&job_lock);
+        list_add_tail(&job->list, &job->owner->done);
+        job_running = NULL;
+        wake_up(&job->owner->wait);
+        spin_unlock(&job_lock);
     }
+    return 0;
+}
 
-    /* Return the result of the test to user space */
-    char device_buf[512];
-    snprintf(device_buf, 512, "%llu %lu", (unsigned long long int) kt_sort, count);
-    unsigned long len = copy_to_user(buf, device_buf, 512);
-    if (len != 0) {
-        printk(KERN_ALERT "Failed to copy data to user\n");
-        return 0;
+static bool sort_file_running(struct sort_file *sf)
+{
+    bool res;
+
+    spin_lock(&job_lock);
+    res = job_running && job_running->owner == sf;
+    spin_unlock(&job_lock);
+    return res;
+}
+
+/* Drop the jobs of `sf`, waiting for the one running */
+static void sort_file_cancel(struct sort_file *sf)
+{
+    struct sort_job *job, *next;
+    LIST_HEAD(jobs);
+
+    spin_lock(&job_lock);
+    list_for_each_entry_safe (job, next, &job_queue, list)
+        if (job->owner == sf)
+            list_move_tail(&job->list, &jobs);
+    spin_unlock(&job_lock);
+
+    wait_event(sf->wait, !sort_file_running(sf));
+    list_splice_init(&sf->done, &jobs);
+    list_for_each_entry_safe (job, next, &jobs, list)
+        kfree(job);
+}
+
+static long sort_job_submit(struct sort_file *sf, const void __user *arg)
+{
+    struct sort_job *job = kzalloc(sizeof(*job), GFP_KERNEL);
+
+    if (!job)
+        return -ENOMEM;
+    if (copy_from_user(&job->job, arg, sizeof(job->job))) {
+        kfree(job);
+        return -EFAULT;
+    }
+    if (job->job.sort_id >= ARRAY_SIZE(tests) - 1) {
+        kfree(job);
+        return -EINVAL;
+    }
+    job->owner = sf;
+    job->result.cookie = job->job.cookie;
+
+    spin_lock(&job_lock);
+    if (sf->jobs >= SORT_TEST_JOBS) {
+        spin_unlock(&job_lock);
+        kfree(job);
+        return -EAGAIN;
     }
+    sf->jobs++;
+    list_add_tail(&job->list, &job_queue);
+    spin_unlock(&job_lock);
 
-    local_irq_enable();
-    put_cpu();
+    wake_up(&job_wait);
+    return 0;
+}
 
-    return size;
+/* Fetch the results of the first finished job of `sf` */
+static long sort_job_result(struct sort_file *sf, void __user *arg)
+{
+    struct sort_job *job;
+
+    spin_lock(&job_lock);
+    job = list_first_entry_or_null(&sf->done, struct sort_job, list);
+    if (job)
+        list_del(&job->list);
+    spin_unlock(&job_lock);
+    if (!job)
+        return -EAGAIN;
+
+    bool fault = copy_to_user(arg, &job->result, sizeof(job->result));
+
+    spin_lock(&job_lock);
+    if (fault)
+        list_add(&job->list, &sf->done);
+    else
+        sf->jobs--;
+    spin_unlock(&job_lock);
+    if (fault)
+        return -EFAULT;
+
+    kfree(job);
+    return 0;
+}
+
+static __poll_t sort_test_poll(struct file *file, poll_table *wait)
+{
+    struct sort_file *sf = file->private_data;
+    __poll_t mask = 0;
+
+    poll_wait(file, &sf->wait, wait);
+    spin_lock(&job_lock);
+    if (!list_empty(&sf->done))
+        mask |= EPOLLIN | EPOLLRDNORM;
+    if (sf->jobs < SORT_TEST_JOBS)
+        mask |= EPOLLOUT | EPOLLWRNORM;
+    spin_unlock(&job_lock);
+    return mask;
 }
 
 static ssize_t sort_test_write(struct file *file, const char __user  *buf, size_t size, loff_t *offset)
 {
+    struct sort_test_job *params =
+        &((struct sort_file *) file->private_data)->params;
+    struct sort_test_job job = *params;
+
     /* Get the test information from user space */
     char device_buf[512];
-    unsigned long len = copy_from_user(device_buf, buf, size);
-    if (len != 0) {
+    size_t len = min(size, sizeof(device_buf) - 1);
+    if (copy_from_user(device_buf, buf, len)) {
         printk(KERN_ALERT "Failed to copy data from user\n");
-        return 0;
+        return -EFAULT;
     }
+    device_buf[len] = '\0';
 
     char *token;
-    char *str = kstrdup(device_buf, GFP_KERNEL);
+    char *dup = kstrdup(device_buf, GFP_KERNEL), *str = dup;
+    if (!dup)
+        return -ENOMEM;
 
-    int counter = 0;
+    int counter = 0, ret = 0;
     /* Update the information of current sort test */
-    while ((token = strsep(&str, " ")) != NULL) {
-        /* Convert the token to an unsigned long long int */
-        long int number = simple_strtol(token, NULL, 10);
+    while (!ret && (token = strsep(&str, " ")) != NULL) {
         if (counter == 0)
-            nodes = (int) number;
+            ret = kstrtou32(token, 10, &job.nodes);
         else if (counter == 1)
-            case_id = (int) number;
+            ret = kstrtou32(token, 10, &job.case_id);
         else if (counter == 2)
-            test = tests[(int) number];
+            ret = kstrtou32(token, 10, &job.sort_id);
+        else if (counter == 3)
+            ret = kstrtou64(token, 10, &job.seed);
+        else if (counter == 4)
+            ret = kstrtou32(token, 10, &job.iteration);
         else
             break;
         counter++;
@@ -335,30 +2268,139 @@ static ssize_t sort_test_write(struct file *file, const char __user  *buf, size_
     // printk(KERN_INFO "The current test info: nodes = %d, case_id = %d, sort program = %s", 
     //        nodes, case_id, test.name);
 
-    kfree(str);
+    kfree(dup);
+    if (ret)
+        return ret;
+    *params = job;
 
     return size;
 }
 
+static long sort_test_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+    switch (cmd) {
+    case SORT_TEST_IOC_PHASES:
+        if (copy_to_user((void __user *) arg, &sort_stats, sizeof(sort_stats)))
+            return -EFAULT;
+        return 0;
+    case SORT_TEST_IOC_SUBMIT:
+        return sort_job_submit(file->private_data, (void __user *) arg);
+    case SORT_TEST_IOC_RESULT:
+        return sort_job_result(file->private_data, (void __user *) arg);
+    case SORT_TEST_IOC_NODE_BYTES: {
+        u64 bytes = 0;
+
+        mutex_lock(&test_lock);
+        if (latch_layout())
+            bytes = node_bytes();
+        mutex_unlock(&test_lock);
+        if (!bytes)
+            return -EINVAL;
+        if (copy_to_user((void __user *) arg, &bytes, sizeof(bytes)))
+            return -EFAULT;
+        return 0;
+    }
+    default:
+        return -ENOTTY;
+    }
+}
+
+/* Map the buffer of the trace keys, see `SORT_CASE_TRACE` */
+static int sort_test_mmap(struct file *file, struct vm_area_struct *vma)
+{
+    size_t size = MAX_LEN * sizeof(*trace_keys);
+    int ret;
+
+    if (vma->vm_pgoff || vma->vm_end - vma->vm_start > PAGE_ALIGN(size))
+        return -EINVAL;
+
+    mutex_lock(&trace_lock);
+    if (!trace_keys)
+        trace_keys = vmalloc_user(size);
+    ret = trace_keys ? remap_vmalloc_range(vma, trace_keys, 0) : -ENOMEM;
+    mutex_unlock(&trace_lock);
+
+    return ret;
+}
+
 /* Set the file operations of the kernel module */
 static const struct file_operations fops = {
     .read = sort_test_read,
     .write = sort_test_write,
+    .unlocked_ioctl = sort_test_ioctl,
+    .poll = sort_test_poll,
+    .mmap = sort_test_mmap,
     .open = sort_test_open,
     .release = sort_test_release,
     .owner = THIS_MODULE,
 };
 
-static int __init sort_test_init(void)
+/* The per-phase work of the last measured sort in
+ * `/sys/kernel/debug/sort_test/phases` */
+static int phases_show(struct seq_file *m, void *v)
 {
-    seed(314159265, 1618033989);  // Initialize PRNG with pi and phi.
+    seq_printf(m, "%-14s %12s %12s %12s\n", "phase", "cmps", "visits",
+               "writes");
+    for (int i = 0; i < SORT_PHASE_NR; i++)
+        seq_printf(m, "%-14s %12llu %12llu %12llu\n", phase_names[i],
+                   sort_stats.cmps[i], sort_stats.visits[i],
+                   sort_stats.writes[i]);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(phases);
+
+/* The sorts of the last concurrent test in `/sys/kernel/debug/sort_test/cpus`,
+ * with the nodes sorted per second by each CPU, and by all of them from the
+ * start to the end of the slowest sort */
+static int cpus_show(struct seq_file *m, void *v)
+{
+    size_t cmps = 0;
+
+    seq_printf(m, "%-5s %12s %12s %14s %12s %12s %12s\n", "cpu", "duration",
+               "cmps", "nodes/s", "max_gap", "yield", "dtlb");
+    mutex_lock(&cpus_lock);
+    for (unsigned int i = 0; i < last_nr_cpus; i++) {
+        const struct sort_run *run = &last_cpus[i].run;
+        u64 ns = max_t(u64, ktime_to_ns(run->duration), 1);
+
+        seq_printf(m, "%-5u %12llu %12zu %14llu %12llu %12llu %12llu\n",
+                   last_cpus[i].cpu, ns, run->count,
+                   div64_u64((u64) last_nodes * NSEC_PER_SEC, ns),
+                   run->resched_max_gap, run->resched_yield,
+                   run->dtlb_misses);
+        cmps += run->count;
+    }
+    if (last_nr_cpus) {
+        u64 wall = max_t(u64, ktime_to_ns(last_wall), 1);
+
+        seq_printf(m, "%-5s %12llu %12zu %14llu\n", "all", wall, cmps,
+                   div64_u64((u64) last_nr_cpus * last_nodes * NSEC_PER_SEC,
+                             wall));
+    }
+    mutex_unlock(&cpus_lock);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(cpus);
 
+static int __init sort_test_init(void)
+{
     struct device *device;
+    unsigned int cpu = job_cpu < 0 ? cpumask_last(cpu_online_mask) : job_cpu;
 
     printk(KERN_INFO DEVICE_NAME ": loaded\n");
 
+    if (cpu >= nr_cpu_ids || !cpu_online(cpu))
+        return -EINVAL;
+    job_task = kthread_create(job_thread, NULL, DEVICE_NAME "/job");
+    if (IS_ERR(job_task))
+        return PTR_ERR(job_task);
+    kthread_bind(job_task, cpu);
+    wake_up_process(job_task);
+    /* for the client to keep off it */
+    job_cpu = cpu;
+
     if (alloc_chrdev_region(&dev, 0, 1, DEVICE_NAME) < 0)
-        return -1;
+        goto error_stop_job;
 #if LINUX_VERSION_CODE < KERNEL_VERSION(6, 4, 0)
     class = class_create(THIS_MODULE, DEVICE_NAME);
 #else
@@ -377,6 +2419,10 @@ static int __init sort_test_init(void)
     if (cdev_add(&cdev, dev, 1) < 0)
         goto error_device_destroy;
 
+    debugfs_dir = debugfs_create_dir(DEVICE_NAME, NULL);
+    debugfs_create_file("phases", 0444, debugfs_dir, NULL, &phases_fops);
+    debugfs_create_file("cpus", 0444, debugfs_dir, NULL, &cpus_fops);
+
     return 0;
 
 error_device_destroy:
@@ -385,16 +2431,22 @@ error_class_destroy:
     class_destroy(class);
 error_unregister_chrdev_region:
     unregister_chrdev_region(dev, 1);
+error_stop_job:
+    kthread_stop(job_task);
 
     return -1;
 }
 
 static void __exit sort_test_exit(void)
 {
+    debugfs_remove_recursive(debugfs_dir);
     device_destroy(class, dev);
     class_destroy(class);
     cdev_del(&cdev);
     unregister_chrdev_region(dev, 1);
+    kthread_stop(job_task);
+    vfree(trace_keys);
+    kfree(last_cpus);
 
     printk(KERN_INFO DEVICE_NAME ": unloaded\n");
 }
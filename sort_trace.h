@@ -0,0 +1,93 @@
+/* The tracepoints of the run-stack engines, which are enough to rebuild the
+ * merge tree of a sort with `trace-cmd` or `perf`:
+ *
+ *   trace-cmd record -e sort_test ...
+ */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM sort_test
+
+#if !defined(_SORT_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _SORT_TRACE_H
+
+#include <linux/tracepoint.h>
+
+/* A run is pushed to the run stack; `len` is the length of the natural run and
+ * `extended` is the length after extending it to minrun */
+TRACE_EVENT(sort_run_found,
+
+    TP_PROTO(size_t len, bool descending, size_t extended),
+
+    TP_ARGS(len, descending, extended),
+
+    TP_STRUCT__entry(
+        __field(size_t, len)
+        __field(bool, descending)
+        __field(size_t, extended)
+    ),
+
+    TP_fast_assign(
+        __entry->len = len;
+        __entry->descending = descending;
+        __entry->extended = extended;
+    ),
+
+    TP_printk("len=%zu descending=%d extended=%zu",
+              __entry->len, __entry->descending, __entry->extended)
+);
+
+/* Two adjacent runs on the stack of `depth` runs are merged; `gallops` is the
+ * number of times the merge entered galloping mode */
+TRACE_EVENT(sort_merge_at,
+
+    TP_PROTO(size_t left, size_t right, size_t depth, size_t gallops),
+
+    TP_ARGS(left, right, depth, gallops),
+
+    TP_STRUCT__entry(
+        __field(size_t, left)
+        __field(size_t, right)
+        __field(size_t, depth)
+        __field(size_t, gallops)
+    ),
+
+    TP_fast_assign(
+        __entry->left = left;
+        __entry->right = right;
+        __entry->depth = depth;
+        __entry->gallops = gallops;
+    ),
+
+    TP_printk("left=%zu right=%zu depth=%zu gallops=%zu",
+              __entry->left, __entry->right, __entry->depth,
+              __entry->gallops)
+);
+
+/* The final merge which rebuilds the prev links; `right` is 0 if the whole
+ * input was left as a single run */
+TRACE_EVENT(sort_merge_final,
+
+    TP_PROTO(size_t left, size_t right),
+
+    TP_ARGS(left, right),
+
+    TP_STRUCT__entry(
+        __field(size_t, left)
+        __field(size_t, right)
+    ),
+
+    TP_fast_assign(
+        __entry->left = left;
+        __entry->right = right;
+    ),
+
+    TP_printk("left=%zu right=%zu", __entry->left, __entry->right)
+);
+
+#endif /* _SORT_TRACE_H */
+
+/* This part must be outside protection */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE sort_trace
+#include <trace/define_trace.h>
@@ -6,8 +6,7 @@
 #include <linux/list.h>
 
 #include "sort.h"
-
-int minrun_b = 0;
+#include "sort_trace.h"
 
 static inline size_t run_size(struct list_head *head)
 {
@@ -22,8 +21,6 @@ struct pair {
     struct list_head *head, *next;
 };
 
-static size_t stk_size;
-
 static struct list_head *merge(void *priv,
                                list_cmp_func_t cmp,
                                struct list_head *a,
@@ -32,12 +29,14 @@ static struct list_head *merge(void *priv,
     struct list_head *head = NULL;
     struct list_head **tail = &head;
 
+    sort_stat_phase(SORT_PHASE_MERGE);
     for (;;) {
         /* if equal, take 'a' -- important for sort stability */
         if (cmp(priv, a, b) <= 0) {
             *tail = a;
             tail = &a->next;
             a = a->next;
+            sort_stat_work(1, 1);
             if (!a) {
                 *tail = b;
                 break;
@@ -46,6 +45,7 @@ static struct list_head *merge(void *priv,
             *tail = b;
             tail = &b->next;
             b = b->next;
+            sort_stat_work(1, 1);
             if (!b) {
                 *tail = a;
                 break;
@@ -55,15 +55,25 @@ static struct list_head *merge(void *priv,
     return head;
 }
 
-static void build_prev_link(struct list_head *head,
+static void build_prev_link(void *priv,
+                            list_cmp_func_t cmp,
+                            struct list_head *head,
                             struct list_head *tail,
                             struct list_head *list)
 {
+    u8 count = 0;
+
     tail->next = list;
     do {
+        /* The rest of an unbalanced merge, or the whole list if it was a
+         * single run, takes no comparison; keep calling back every 256 nodes
+         * anyway so that cmp() can cond_resched() */
+        if (unlikely(!++count))
+            cmp(priv, list, list);
         list->prev = tail;
         tail = list;
         list = list->next;
+        sort_stat_work(1, 1);
     } while (list);
 
     /* The final links to make a circular doubly-linked list */
@@ -79,6 +89,7 @@ static void merge_final(void *priv,
 {
     struct list_head *tail = head;
 
+    sort_stat_phase(SORT_PHASE_MERGE_FINAL);
     for (;;) {
         /* if equal, take 'a' -- important for sort stability */
         if (cmp(priv, a, b) <= 0) {
@@ -86,6 +97,7 @@ static void merge_final(void *priv,
             a->prev = tail;
             tail = a;
             a = a->next;
+            sort_stat_work(1, 2);
             if (!a)
                 break;
         } else {
@@ -93,6 +105,7 @@ static void merge_final(void *priv,
             b->prev = tail;
             tail = b;
             b = b->next;
+            sort_stat_work(1, 2);
             if (!b) {
                 b = a;
                 break;
@@ -101,26 +114,86 @@ static void merge_final(void *priv,
     }
 
     /* Finish linking remainder of list b on to tail */
-    build_prev_link(head, tail, b);
+    build_prev_link(priv, cmp, head, tail, b);
+}
+
+/* The binary insertion sort to extend the run started from `head` to the
+ * length of `minrun`.
+ *
+ * The run is loaded into an on-stack array of at most `MAX_MINRUN` pointers,
+ * so each step of the binary search reaches its middle node directly instead
+ * of walking the prev/next links, and the run is relinked only once after the
+ * last insertion.
+ */
+static struct list_head *binary_insertion(void *priv,
+                                          list_cmp_func_t cmp,
+                                          struct list_head *head,
+                                          struct list_head **next,
+                                          size_t *len,
+                                          int minrun)
+{
+    struct list_head *run[MAX_MINRUN];
+    struct list_head *in_node = *next;
+    size_t n = 0;
+
+    sort_stat_phase(SORT_PHASE_INSERTION);
+    for (struct list_head *curr = head; curr; curr = curr->next)
+        run[n++] = curr;
+    sort_stat_work(n, 0);
+
+    for (; in_node && n < minrun; in_node = in_node->next) {
+        size_t left = 0, right = n;
+
+        /* search for the slot after the last node which is not larger than
+         * `in_node` -- important for sort stability */
+        while (left < right) {
+            size_t middle = (left + right) >> 1;
+            if (cmp(priv, run[middle], in_node) <= 0)
+                left = middle + 1;
+            else
+                right = middle;
+        }
+
+        memmove(&run[left + 1], &run[left], (n - left) * sizeof(*run));
+        run[left] = in_node;
+        n++;
+        sort_stat_work(1, 0);
+    }
+
+    /* Relink the nodes in the order of the array */
+    for (size_t i = 1; i < n; i++)
+        run[i - 1]->next = run[i];
+    run[n - 1]->next = NULL;
+    sort_stat_work(0, n);
+
+    *next = in_node;
+    *len = n;
+    return run[0];
 }
 
 static struct pair find_run(void *priv,
                             struct list_head *list,
-                            list_cmp_func_t cmp)
+                            list_cmp_func_t cmp,
+                            int minrun)
 {
     // printf("start find run\n");
     size_t len = 1;
     struct list_head *next = list->next, *head = list;
     struct pair result;
+    bool descending = false;
 
     if (!next) {
+        trace_sort_run_found(1, false, 1);
         result.head = head, result.next = next;
         return result;
     }
 
+    sort_stat_phase(SORT_PHASE_RUN_DETECT);
     if (cmp(priv, list, next) > 0) {
         /* decending run, also reverse the list */
         struct list_head *prev = NULL;
+        descending = true;
+        sort_stat_phase(SORT_PHASE_RUN_REVERSE);
         do {
             len++;
             list->next = prev;
@@ -128,6 +201,7 @@ static struct pair find_run(void *priv,
             list = next;
             next = list->next;
             head = list;
+            sort_stat_work(1, 1);
         } while (next && cmp(priv, list, next) > 0);
         list->next = prev;
     } else {
@@ -135,108 +209,18 @@ static struct pair find_run(void *priv,
             len++;
             list = next;
             next = list->next;
+            sort_stat_work(1, 0);
         } while (next && cmp(priv, list, next) <= 0);
         list->next = NULL;
     }
+    size_t natural = len;
 
     /* Trigger this piece of code to fill the node in the run until its size
-     * equals to `minrun_b` */
-    if (len < minrun_b) {
-        /* rebuild the prev links for each node to ensure we won't meet issues
-         * with infinite loops or segmentation fault during binary insertion
-         * sort.*/
-        for (struct list_head *curr = head; curr && curr->next;
-             curr = curr->next)
-            curr->next->prev = curr;
-
-        /* the binary insertion sort */
-        for (struct list_head *in_node = next; in_node && len < minrun_b;
-             len++) {
-            struct list_head *safe = in_node->next;
-
-            /* holding special case for being smaller than the head node */
-            if (cmp(priv, in_node, head) <= 0) {
-                in_node->prev = head->prev;
-                in_node->next = head;
-                head->prev = in_node;
-                head = in_node;
-
-                in_node = safe;
-                next = in_node;
-                continue;
-            }
-
-            int x = 1, y = len;
-            int middle = (x & y) + ((x ^ y) >> 1);
-
-            struct list_head *curr = head;
-            int direction = -1; /* 0 -> left ; 1 -> right */
-            while (1) {
-                /* moving the pointer to the middle node of the current section
-                 */
-                if (direction) {
-                    for (int n = x; n != middle; n++)
-                        curr = curr->next;
-
-                } else {
-                    for (int n = y; n != middle; n--)
-                        curr = curr->prev;
-                }
-
-                /* check if it meets the break condition (this step won't be
-                 * used in the first step) */
-                if (direction >= 0 && (x == y || x == middle)) {
-                    in_node->prev = curr;
-                    in_node->next = curr->next;
-                    if (in_node->next)
-                        in_node->next->prev = in_node;
-                    curr->next = in_node;
-                    break;
-                }
-
-                /* decide the direction of the next move */
-                if (cmp(priv, in_node, curr) > 0) {
-                    x = middle;
-                    direction = 1;
-                } else {
-                    y = middle;
-                    direction = 0;
-                }
-                /* update the information of the middle node (takes the ceiling
-                 * of the result) */
-                middle = (x & y) + ((x ^ y) >> 1);
-
-                if (x == middle && y - x == 1) {
-                    if (!direction) {
-                        /* hold the insertion slot is before the first node of
-                         * the section */
-                        if (cmp(priv, in_node, curr->prev) <= 0) {
-                            curr = curr->prev;
-                            in_node->prev = curr->prev;
-                            in_node->next = curr;
-                            break;
-                        }
-                    } else {
-                        /* hold the insertion slot is after the last node of the
-                         * section  */
-                        if (cmp(priv, in_node, curr->next) > 0) {
-                            curr = curr->next;
-                            in_node->prev = curr;
-                            in_node->next = curr->next;
-                            if (in_node->next)
-                                in_node->next->prev = in_node;
-                            curr->next = in_node;
-                            break;
-                        }
-                    }
-                }
-            }
-
-            in_node = safe;
-            next = in_node;
-        }
-    }
+     * equals to `minrun` */
+    if (len < minrun)
+        head = binary_insertion(priv, cmp, head, &next, &len, minrun);
 
+    trace_sort_run_found(natural, descending, len);
     head->prev = NULL;
     head->next->prev = (struct list_head *) len;
     result.head = head, result.next = next;
@@ -245,26 +229,31 @@ static struct pair find_run(void *priv,
 
 static struct list_head *merge_at(void *priv,
                                   list_cmp_func_t cmp,
-                                  struct list_head *at)
+                                  struct list_head *at,
+                                  size_t *stk_size)
 {
-    size_t len = run_size(at) + run_size(at->prev);
+    size_t left = run_size(at->prev), right = run_size(at);
+    size_t len = left + right;
+    sort_stat_cost(len);
     struct list_head *prev = at->prev->prev;
     struct list_head *list = merge(priv, cmp, at->prev, at);
+    trace_sort_merge_at(left, right, *stk_size, 0);
     list->prev = prev;
     list->next->prev = (struct list_head *) len;
-    --stk_size;
+    --*stk_size;
     return list;
 }
 
 static struct list_head *merge_force_collapse(void *priv,
                                               list_cmp_func_t cmp,
-                                              struct list_head *tp)
+                                              struct list_head *tp,
+                                              size_t *stk_size)
 {
-    while (stk_size >= 3) {
+    while (*stk_size >= 3) {
         if (run_size(tp->prev->prev) < run_size(tp)) {
-            tp->prev = merge_at(priv, cmp, tp->prev);
+            tp->prev = merge_at(priv, cmp, tp->prev, stk_size);
         } else {
-            tp = merge_at(priv, cmp, tp);
+            tp = merge_at(priv, cmp, tp, stk_size);
         }
     }
     return tp;
@@ -272,21 +261,22 @@ static struct list_head *merge_force_collapse(void *priv,
 
 static struct list_head *merge_collapse(void *priv,
                                         list_cmp_func_t cmp,
-                                        struct list_head *tp)
+                                        struct list_head *tp,
+                                        size_t *stk_size)
 {
     int n;
-    while ((n = stk_size) >= 2) {
+    while ((n = *stk_size) >= 2) {
         if ((n >= 3 &&
              run_size(tp->prev->prev) <= run_size(tp->prev) + run_size(tp)) ||
             (n >= 4 && run_size(tp->prev->prev->prev) <=
                            run_size(tp->prev->prev) + run_size(tp->prev))) {
             if (run_size(tp->prev->prev) < run_size(tp)) {
-                tp->prev = merge_at(priv, cmp, tp->prev);
+                tp->prev = merge_at(priv, cmp, tp->prev, stk_size);
             } else {
-                tp = merge_at(priv, cmp, tp);
+                tp = merge_at(priv, cmp, tp, stk_size);
             }
         } else if (run_size(tp->prev) <= run_size(tp)) {
-            tp = merge_at(priv, cmp, tp);
+            tp = merge_at(priv, cmp, tp, stk_size);
         } else {
             break;
         }
@@ -295,6 +285,21 @@ static struct list_head *merge_collapse(void *priv,
     return tp;
 }
 
+/* list_count_nodes(), calling back every 256 nodes like build_prev_link() as
+ * it takes no comparison either */
+static size_t count_nodes(void *priv,
+                          list_cmp_func_t cmp,
+                          struct list_head *head)
+{
+    struct list_head *node;
+    size_t count = 0;
+
+    list_for_each (node, head)
+        if (unlikely(!(++count & 0xff)))
+            cmp(priv, node, node);
+    return count;
+}
+
 static int find_minrun(int size)
 {
     int one = 0;
@@ -311,8 +316,12 @@ static int find_minrun(int size)
 
 void timsort_binary(void *priv, struct list_head *head, list_cmp_func_t cmp)
 {
-    stk_size = 0;
-    minrun_b = find_minrun(list_count_nodes(head));
+    /* Few distinct keys; bucket the equal nodes instead of finding runs */
+    if (lowcard_fallback && lowcard_sort_try(priv, head, cmp))
+        return;
+
+    size_t stk_size = 0;
+    int minrun = find_minrun(count_nodes(priv, cmp, head));
 
     struct list_head *list = head->next, *tp = NULL;
     if (head == head->prev)
@@ -323,24 +332,27 @@ void timsort_binary(void *priv, struct list_head *head, list_cmp_func_t cmp)
 
     do {
         /* Find next run */
-        struct pair result = find_run(priv, list, cmp);
+        struct pair result = find_run(priv, list, cmp, minrun);
         result.head->prev = tp;
         tp = result.head;
         list = result.next;
         stk_size++;
-        tp = merge_collapse(priv, cmp, tp);
+        tp = merge_collapse(priv, cmp, tp, &stk_size);
     } while (list);
 
     /* End of input; merge together all the runs. */
-    tp = merge_force_collapse(priv, cmp, tp);
+    tp = merge_force_collapse(priv, cmp, tp, &stk_size);
 
     /* The final merge; rebuild prev links */
     struct list_head *stk0 = tp, *stk1 = stk0->prev;
     while (stk1 && stk1->prev)
         stk0 = stk0->prev, stk1 = stk1->prev;
     if (stk_size <= 1) {
-        build_prev_link(head, head, stk0);
+        trace_sort_merge_final(run_size(stk0), 0);
+        build_prev_link(priv, cmp, head, head, stk0);
         return;
     }
+    trace_sort_merge_final(run_size(stk1), run_size(stk0));
+    sort_stat_cost(run_size(stk1) + run_size(stk0));
     merge_final(priv, cmp, head, stk1, stk0);
 }
\ No newline at end of file
@@ -6,11 +6,10 @@
 #include <linux/list.h>
 
 #include "sort.h"
+#include "sort_trace.h"
 
 #define MIN_GALLOP 7
 
-int minrun_g = 0;
-
 static inline size_t run_size(struct list_head *head)
 {
     if (!head)
@@ -24,26 +23,28 @@ struct pair {
     struct list_head *head, *next;
 };
 
-static size_t stk_size;
-
 static struct list_head *merge(void *priv,
                                list_cmp_func_t cmp,
                                struct list_head *a,
-                               struct list_head *b)
+                               struct list_head *b,
+                               size_t *gallop_entries)
 {
     struct list_head *head = NULL;
     struct list_head **tail = &head;
+    u8 count = 0;
     
     /* parameters for saving the continious visit in each list */
     int gallop_cnt_a = 0, gallop_cnt_b = 0;
     int min_gallop = MIN_GALLOP;
 
+    sort_stat_phase(SORT_PHASE_MERGE);
     for (;;) {
         /* if equal, take 'a' -- important for sort stability */
         if (cmp(priv, a, b) <= 0) {
             *tail = a;
             tail = &a->next;
             a = a->next;
+            sort_stat_work(1, 1);
 
             gallop_cnt_b = 0;
             gallop_cnt_a++;
@@ -56,6 +57,7 @@ static struct list_head *merge(void *priv,
             *tail = b;
             tail = &b->next;
             b = b->next;
+            sort_stat_work(1, 1);
 
             gallop_cnt_a = 0;
             gallop_cnt_b++;
@@ -71,6 +73,8 @@ static struct list_head *merge(void *priv,
             struct list_head *p, *insert;
             p = (gallop_cnt_a >= MIN_GALLOP) ? a : b;
             insert = (gallop_cnt_a >= MIN_GALLOP) ? b : a;
+            sort_stat_phase(SORT_PHASE_GALLOP_SEARCH);
+            (*gallop_entries)++;
 
             /* the exponential searching*/
             int n_prev = 0, n_curr = 0;
@@ -97,7 +101,12 @@ static struct list_head *merge(void *priv,
                             n_curr -= cnt;
                             break;
                         }
+                        /* the steps grow with the run, call back while
+                         * walking them */
+                        if (unlikely(!++count))
+                            cmp(priv, p, p);
                         p = p->next;
+                        sort_stat_work(1, 0);
                     }
                 }
             }
@@ -107,6 +116,7 @@ static struct list_head *merge(void *priv,
                 tail = &p_prev->next;
 
             /* adress of the value of the current miinimum gallop */
+            sort_stat_phase(SORT_PHASE_GALLOP_INSERT);
             int gallop = min_gallop;
             /* linear insertion */
             struct list_head *g_curr = n_curr ? p_prev->next : p_prev;
@@ -117,10 +127,12 @@ static struct list_head *merge(void *priv,
                     *tail = insert;
                     tail = &insert->next;
                     insert = insert->next;
+                    sort_stat_work(1, 1);
                 }
                 *tail = g_curr;
                 tail = &g_curr->next;
                 g_curr = g_curr->next;
+                sort_stat_work(1, 1);
             }
 
             /* NULL pointer handler */
@@ -139,6 +151,7 @@ static struct list_head *merge(void *priv,
             a = (gallop_cnt_a >= MIN_GALLOP) ? g_curr : insert;
             b = (gallop_cnt_a >= MIN_GALLOP) ? insert : g_curr;
 
+            sort_stat_phase(SORT_PHASE_MERGE);
             min_gallop++; /* update the counter of the minimum gallop */
             gallop_cnt_a = 0;
             gallop_cnt_b = 0;
@@ -148,15 +161,25 @@ static struct list_head *merge(void *priv,
     return head;
 }
 
-static void build_prev_link(struct list_head *head,
+static void build_prev_link(void *priv,
+                            list_cmp_func_t cmp,
+                            struct list_head *head,
                             struct list_head *tail,
                             struct list_head *list)
 {
+    u8 count = 0;
+
     tail->next = list;
     do {
+        /* The rest of an unbalanced merge, or the whole list if it was a
+         * single run, takes no comparison; keep calling back every 256 nodes
+         * anyway so that cmp() can cond_resched() */
+        if (unlikely(!++count))
+            cmp(priv, list, list);
         list->prev = tail;
         tail = list;
         list = list->next;
+        sort_stat_work(1, 1);
     } while (list);
 
     /* The final links to make a circular doubly-linked list */
@@ -172,6 +195,7 @@ static void merge_final(void *priv,
 {
     struct list_head *tail = head;
 
+    sort_stat_phase(SORT_PHASE_MERGE_FINAL);
     for (;;) {
         /* if equal, take 'a' -- important for sort stability */
         if (cmp(priv, a, b) <= 0) {
@@ -179,6 +203,7 @@ static void merge_final(void *priv,
             a->prev = tail;
             tail = a;
             a = a->next;
+            sort_stat_work(1, 2);
 
             if (!a)
                 break;
@@ -187,6 +212,7 @@ static void merge_final(void *priv,
             b->prev = tail;
             tail = b;
             b = b->next;
+            sort_stat_work(1, 2);
 
             if (!b) {
                 b = a;
@@ -196,25 +222,31 @@ static void merge_final(void *priv,
     }
     
     /* Finish linking remainder of list b on to tail */
-    build_prev_link(head, tail, b);
+    build_prev_link(priv, cmp, head, tail, b);
 }
 
 static struct pair find_run(void *priv,
                             struct list_head *list,
-                            list_cmp_func_t cmp)
+                            list_cmp_func_t cmp,
+                            int minrun)
 {
     size_t len = 1;
     struct list_head *next = list->next, *head = list;
     struct pair result;
+    bool descending = false;
 
     if (!next) {
+        trace_sort_run_found(1, false, 1);
         result.head = head, result.next = next;
         return result;
     }
 
+    sort_stat_phase(SORT_PHASE_RUN_DETECT);
     if (cmp(priv, list, next) > 0) {
         /* decending run, also reverse the list */
         struct list_head *prev = NULL;
+        descending = true;
+        sort_stat_phase(SORT_PHASE_RUN_REVERSE);
         do {
             len++;
             list->next = prev;
@@ -222,6 +254,7 @@ static struct pair find_run(void *priv,
             list = next;
             next = list->next;
             head = list;
+            sort_stat_work(1, 1);
         } while (next && cmp(priv, list, next) > 0);
         list->next = prev;
     } else {
@@ -229,18 +262,23 @@ static struct pair find_run(void *priv,
             len++;
             list = next;
             next = list->next;
+            sort_stat_work(1, 0);
         } while (next && cmp(priv, list, next) <= 0);
         list->next = NULL;
     }
+    size_t natural = len;
 
     // rebuild the prev links for each node (important step if need to do
     // insertion sort)
-    for (struct list_head *curr = head; curr && curr->next; curr = curr->next)
+    sort_stat_phase(SORT_PHASE_INSERTION);
+    for (struct list_head *curr = head; curr && curr->next; curr = curr->next) {
         curr->next->prev = curr;
+        sort_stat_work(1, 1);
+    }
 
     // insertion sort for inserting the elements for making every run be
     // approximately equal length.
-    for (struct list_head *in_node = next; in_node && len < minrun_g; len++) {
+    for (struct list_head *in_node = next; in_node && len < minrun; len++) {
         struct list_head *safe = in_node->next;
 
         // case for first node hit
@@ -248,6 +286,7 @@ static struct pair find_run(void *priv,
             in_node->next = head;
             head->prev = in_node;
             head = in_node;
+            sort_stat_work(1, 3);
 
             in_node = safe;
             next = in_node;
@@ -265,9 +304,11 @@ static struct pair find_run(void *priv,
                     if (curr->next->next) {
                         prev = curr->next;
                         curr = curr->next->next;
+                        sort_stat_work(2, 0);
                     } else {
                         prev = curr;
                         curr = curr->next;
+                        sort_stat_work(1, 0);
                     }
                 } else {
                     prev = curr;
@@ -290,11 +331,13 @@ static struct pair find_run(void *priv,
         if (curr) {
             curr->prev = in_node;
         }
+        sort_stat_work(1, 4);
 
         in_node = safe;
         next = in_node;
     }
 
+    trace_sort_run_found(natural, descending, len);
     head->prev = NULL;
     head->next->prev = (struct list_head *) len;
     result.head = head, result.next = next;
@@ -303,26 +346,33 @@ static struct pair find_run(void *priv,
 
 static struct list_head *merge_at(void *priv,
                                   list_cmp_func_t cmp,
-                                  struct list_head *at)
+                                  struct list_head *at,
+                                  size_t *stk_size)
 {
-    size_t len = run_size(at) + run_size(at->prev);
+    size_t left = run_size(at->prev), right = run_size(at);
+    size_t len = left + right;
+    sort_stat_cost(len);
     struct list_head *prev = at->prev->prev;
-    struct list_head *list = merge(priv, cmp, at->prev, at);
+    /* the times galloping mode is entered in this merge */
+    size_t gallop_entries = 0;
+    struct list_head *list = merge(priv, cmp, at->prev, at, &gallop_entries);
+    trace_sort_merge_at(left, right, *stk_size, gallop_entries);
     list->prev = prev;
     list->next->prev = (struct list_head *) len;
-    --stk_size;
+    --*stk_size;
     return list;
 }
 
 static struct list_head *merge_force_collapse(void *priv,
                                               list_cmp_func_t cmp,
-                                              struct list_head *tp)
+                                              struct list_head *tp,
+                                              size_t *stk_size)
 {
-    while (stk_size >= 3) {
+    while (*stk_size >= 3) {
         if (run_size(tp->prev->prev) < run_size(tp)) {
-            tp->prev = merge_at(priv, cmp, tp->prev);
+            tp->prev = merge_at(priv, cmp, tp->prev, stk_size);
         } else {
-            tp = merge_at(priv, cmp, tp);
+            tp = merge_at(priv, cmp, tp, stk_size);
         }
     }
     return tp;
@@ -330,21 +380,22 @@ static struct list_head *merge_force_collapse(void *priv,
 
 static struct list_head *merge_collapse(void *priv,
                                         list_cmp_func_t cmp,
-                                        struct list_head *tp)
+                                        struct list_head *tp,
+                                        size_t *stk_size)
 {
     int n;
-    while ((n = stk_size) >= 2) {
+    while ((n = *stk_size) >= 2) {
         if ((n >= 3 &&
              run_size(tp->prev->prev) <= run_size(tp->prev) + run_size(tp)) ||
             (n >= 4 && run_size(tp->prev->prev->prev) <=
                            run_size(tp->prev->prev) + run_size(tp->prev))) {
             if (run_size(tp->prev->prev) < run_size(tp)) {
-                tp->prev = merge_at(priv, cmp, tp->prev);
+                tp->prev = merge_at(priv, cmp, tp->prev, stk_size);
             } else {
-                tp = merge_at(priv, cmp, tp);
+                tp = merge_at(priv, cmp, tp, stk_size);
             }
         } else if (run_size(tp->prev) <= run_size(tp)) {
-            tp = merge_at(priv, cmp, tp);
+            tp = merge_at(priv, cmp, tp, stk_size);
         } else {
             break;
         }
@@ -353,6 +404,21 @@ static struct list_head *merge_collapse(void *priv,
     return tp;
 }
 
+/* list_count_nodes(), calling back every 256 nodes like build_prev_link() as
+ * it takes no comparison either */
+static size_t count_nodes(void *priv,
+                          list_cmp_func_t cmp,
+                          struct list_head *head)
+{
+    struct list_head *node;
+    size_t count = 0;
+
+    list_for_each (node, head)
+        if (unlikely(!(++count & 0xff)))
+            cmp(priv, node, node);
+    return count;
+}
+
 static int find_minrun(int size)
 {
     int one = 0;
@@ -369,8 +435,12 @@ static int find_minrun(int size)
 
 void timsort_l_gallop(void *priv, struct list_head *head, list_cmp_func_t cmp)
 {
-    stk_size = 0;
-    minrun_g = find_minrun(list_count_nodes(head));
+    /* Few distinct keys; bucket the equal nodes instead of finding runs */
+    if (lowcard_fallback && lowcard_sort_try(priv, head, cmp))
+        return;
+
+    size_t stk_size = 0;
+    int minrun = find_minrun(count_nodes(priv, cmp, head));
 
     struct list_head *list = head->next, *tp = NULL;
     if (head == head->prev)
@@ -381,16 +451,16 @@ void timsort_l_gallop(void *priv, struct list_head *head, list_cmp_func_t cmp)
 
     do {
         /* Find next run */
-        struct pair result = find_run(priv, list, cmp);
+        struct pair result = find_run(priv, list, cmp, minrun);
         result.head->prev = tp;
         tp = result.head;
         list = result.next;
         stk_size++;
-        tp = merge_collapse(priv, cmp, tp);
+        tp = merge_collapse(priv, cmp, tp, &stk_size);
     } while (list);
 
     /* End of input; merge together all the runs. */
-    tp = merge_force_collapse(priv, cmp, tp);
+    tp = merge_force_collapse(priv, cmp, tp, &stk_size);
     // printf("going to final merge\n");
 
     /* The final merge; rebuild prev links */
@@ -398,8 +468,11 @@ void timsort_l_gallop(void *priv, struct list_head *head, list_cmp_func_t cmp)
     while (stk1 && stk1->prev)
         stk0 = stk0->prev, stk1 = stk1->prev;
     if (stk_size <= 1) {
-        build_prev_link(head, head, stk0);
+        trace_sort_merge_final(run_size(stk0), 0);
+        build_prev_link(priv, cmp, head, head, stk0);
         return;
     }
+    trace_sort_merge_final(run_size(stk1), run_size(stk0));
+    sort_stat_cost(run_size(stk1) + run_size(stk0));
     merge_final(priv, cmp, head, stk1, stk0);
 }
\ No newline at end of file
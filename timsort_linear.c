@@ -6,8 +6,7 @@
 #include <linux/list.h>
 
 #include "sort.h"
-
-int minrun = 0;
+#include "sort_trace.h"
 
 static inline size_t run_size(struct list_head *head)
 {
@@ -22,8 +21,6 @@ struct pair {
     struct list_head *head, *next;
 };
 
-static size_t stk_size;
-
 static struct list_head *merge(void *priv,
                                list_cmp_func_t cmp,
                                struct list_head *a,
@@ -32,12 +29,14 @@ static struct list_head *merge(void *priv,
     struct list_head *head = NULL;
     struct list_head **tail = &head;
 
+    sort_stat_phase(SORT_PHASE_MERGE);
     for (;;) {
         /* if equal, take 'a' -- important for sort stability */
         if (cmp(priv, a, b) <= 0) {
             *tail = a;
             tail = &a->next;
             a = a->next;
+            sort_stat_work(1, 1);
             if (!a) {
                 *tail = b;
                 break;
@@ -46,6 +45,7 @@ static struct list_head *merge(void *priv,
             *tail = b;
             tail = &b->next;
             b = b->next;
+            sort_stat_work(1, 1);
             if (!b) {
                 *tail = a;
                 break;
@@ -55,15 +55,25 @@ static struct list_head *merge(void *priv,
     return head;
 }
 
-static void build_prev_link(struct list_head *head,
+static void build_prev_link(void *priv,
+                            list_cmp_func_t cmp,
+                            struct list_head *head,
                             struct list_head *tail,
                             struct list_head *list)
 {
+    u8 count = 0;
+
     tail->next = list;
     do {
+        /* The rest of an unbalanced merge, or the whole list if it was a
+         * single run, takes no comparison; keep calling back every 256 nodes
+         * anyway so that cmp() can cond_resched() */
+        if (unlikely(!++count))
+            cmp(priv, list, list);
         list->prev = tail;
         tail = list;
         list = list->next;
+        sort_stat_work(1, 1);
     } while (list);
 
     /* The final links to make a circular doubly-linked list */
@@ -79,6 +89,7 @@ static void merge_final(void *priv,
 {
     struct list_head *tail = head;
 
+    sort_stat_phase(SORT_PHASE_MERGE_FINAL);
     for (;;) {
         /* if equal, take 'a' -- important for sort stability */
         if (cmp(priv, a, b) <= 0) {
@@ -86,6 +97,7 @@ static void merge_final(void *priv,
             a->prev = tail;
             tail = a;
             a = a->next;
+            sort_stat_work(1, 2);
             if (!a)
                 break;
         } else {
@@ -93,6 +105,7 @@ static void merge_final(void *priv,
             b->prev = tail;
             tail = b;
             b = b->next;
+            sort_stat_work(1, 2);
             if (!b) {
                 b = a;
                 break;
@@ -101,26 +114,32 @@ static void merge_final(void *priv,
     }
 
     /* Finish linking remainder of list b on to tail */
-    build_prev_link(head, tail, b);
+    build_prev_link(priv, cmp, head, tail, b);
 }
 
 static struct pair find_run(void *priv,
                             struct list_head *list,
-                            list_cmp_func_t cmp)
+                            list_cmp_func_t cmp,
+                            int minrun)
 {
     // printf("start find run\n");
     size_t len = 1;
     struct list_head *next = list->next, *head = list;
     struct pair result;
+    bool descending = false;
 
     if (!next) {
+        trace_sort_run_found(1, false, 1);
         result.head = head, result.next = next;
         return result;
     }
 
+    sort_stat_phase(SORT_PHASE_RUN_DETECT);
     if (cmp(priv, list, next) > 0) {
         /* decending run, also reverse the list */
         struct list_head *prev = NULL;
+        descending = true;
+        sort_stat_phase(SORT_PHASE_RUN_REVERSE);
         do {
             len++;
             list->next = prev;
@@ -128,6 +147,7 @@ static struct pair find_run(void *priv,
             list = next;
             next = list->next;
             head = list;
+            sort_stat_work(1, 1);
         } while (next && cmp(priv, list, next) > 0);
         list->next = prev;
         // printf("\nreverse\n");
@@ -136,14 +156,23 @@ static struct pair find_run(void *priv,
             len++;
             list = next;
             next = list->next;
+            sort_stat_work(1, 0);
         } while (next && cmp(priv, list, next) <= 0);
         list->next = NULL;
     }
+    size_t natural = len;
 
     // rebuild the prev links for each node (important step if need to do
     // insertion sort)
-    for (struct list_head *curr = head; curr && curr->next; curr = curr->next)
+    sort_stat_phase(SORT_PHASE_INSERTION);
+    u8 count = 0;
+    for (struct list_head *curr = head; curr && curr->next; curr = curr->next) {
+        /* a natural run may be the whole list */
+        if (unlikely(!++count))
+            cmp(priv, curr, curr);
         curr->next->prev = curr;
+        sort_stat_work(1, 1);
+    }
 
     // insertion sort for inserting the elements for making every run be
     // approximately equal length.
@@ -155,6 +184,7 @@ static struct pair find_run(void *priv,
             in_node->next = head;
             head->prev = in_node;
             head = in_node;
+            sort_stat_work(1, 3);
 
             in_node = safe;
             next = in_node;
@@ -172,9 +202,11 @@ static struct pair find_run(void *priv,
                     if (curr->next->next) {
                         prev = curr->next;
                         curr = curr->next->next;
+                        sort_stat_work(2, 0);
                     } else {
                         prev = curr;
                         curr = curr->next;
+                        sort_stat_work(1, 0);
                     }
                 } else {
                     prev = curr;
@@ -196,12 +228,14 @@ static struct pair find_run(void *priv,
         prev->next = in_node;
         if (curr) {
             curr->prev = in_node;
-        } 
+        }
+        sort_stat_work(1, 4);
 
         in_node = safe;
         next = in_node;
     }
 
+    trace_sort_run_found(natural, descending, len);
     head->prev = NULL;
     head->next->prev = (struct list_head *) len;
     result.head = head, result.next = next;
@@ -210,26 +244,31 @@ static struct pair find_run(void *priv,
 
 static struct list_head *merge_at(void *priv,
                                   list_cmp_func_t cmp,
-                                  struct list_head *at)
+                                  struct list_head *at,
+                                  size_t *stk_size)
 {
-    size_t len = run_size(at) + run_size(at->prev);
+    size_t left = run_size(at->prev), right = run_size(at);
+    size_t len = left + right;
+    sort_stat_cost(len);
     struct list_head *prev = at->prev->prev;
     struct list_head *list = merge(priv, cmp, at->prev, at);
+    trace_sort_merge_at(left, right, *stk_size, 0);
     list->prev = prev;
     list->next->prev = (struct list_head *) len;
-    --stk_size;
+    --*stk_size;
     return list;
 }
 
 static struct list_head *merge_force_collapse(void *priv,
                                               list_cmp_func_t cmp,
-                                              struct list_head *tp)
+                                              struct list_head *tp,
+                                              size_t *stk_size)
 {
-    while (stk_size >= 3) {
+    while (*stk_size >= 3) {
         if (run_size(tp->prev->prev) < run_size(tp)) {
-            tp->prev = merge_at(priv, cmp, tp->prev);
+            tp->prev = merge_at(priv, cmp, tp->prev, stk_size);
         } else {
-            tp = merge_at(priv, cmp, tp);
+            tp = merge_at(priv, cmp, tp, stk_size);
         }
     }
     return tp;
@@ -237,21 +276,22 @@ static struct list_head *merge_force_collapse(void *priv,
 
 static struct list_head *merge_collapse(void *priv,
                                         list_cmp_func_t cmp,
-                                        struct list_head *tp)
+                                        struct list_head *tp,
+                                        size_t *stk_size)
 {
     int n;
-    while ((n = stk_size) >= 2) {
+    while ((n = *stk_size) >= 2) {
         if ((n >= 3 &&
              run_size(tp->prev->prev) <= run_size(tp->prev) + run_size(tp)) ||
             (n >= 4 && run_size(tp->prev->prev->prev) <=
                            run_size(tp->prev->prev) + run_size(tp->prev))) {
             if (run_size(tp->prev->prev) < run_size(tp)) {
-                tp->prev = merge_at(priv, cmp, tp->prev);
+                tp->prev = merge_at(priv, cmp, tp->prev, stk_size);
             } else {
-                tp = merge_at(priv, cmp, tp);
+                tp = merge_at(priv, cmp, tp, stk_size);
             }
         } else if (run_size(tp->prev) <= run_size(tp)) {
-            tp = merge_at(priv, cmp, tp);
+            tp = merge_at(priv, cmp, tp, stk_size);
         } else {
             break;
         }
@@ -260,6 +300,21 @@ static struct list_head *merge_collapse(void *priv,
     return tp;
 }
 
+/* list_count_nodes(), calling back every 256 nodes like build_prev_link() as
+ * it takes no comparison either */
+static size_t count_nodes(void *priv,
+                          list_cmp_func_t cmp,
+                          struct list_head *head)
+{
+    struct list_head *node;
+    size_t count = 0;
+
+    list_for_each (node, head)
+        if (unlikely(!(++count & 0xff)))
+            cmp(priv, node, node);
+    return count;
+}
+
 static int find_minrun(int size)
 {
     int one = 0;
@@ -279,8 +334,12 @@ void timsort_linear(void *priv, struct list_head *head, list_cmp_func_t cmp)
     if (!head || list_empty(head) || list_is_singular(head))
         return;
 
-    stk_size = 0;
-    minrun = find_minrun(list_count_nodes(head));
+    /* Few distinct keys; bucket the equal nodes instead of finding runs */
+    if (lowcard_fallback && lowcard_sort_try(priv, head, cmp))
+        return;
+
+    size_t stk_size = 0;
+    int minrun = find_minrun(count_nodes(priv, cmp, head));
 
     struct list_head *list = head->next, *tp = NULL;
     if (head == head->prev)
@@ -291,24 +350,27 @@ void timsort_linear(void *priv, struct list_head *head, list_cmp_func_t cmp)
 
     do {
         /* Find next run */
-        struct pair result = find_run(priv, list, cmp);
+        struct pair result = find_run(priv, list, cmp, minrun);
         result.head->prev = tp;
         tp = result.head;
         list = result.next;
         stk_size++;
-        tp = merge_collapse(priv, cmp, tp);
+        tp = merge_collapse(priv, cmp, tp, &stk_size);
     } while (list);
 
     /* End of input; merge together all the runs. */
-    tp = merge_force_collapse(priv, cmp, tp);
+    tp = merge_force_collapse(priv, cmp, tp, &stk_size);
 
     /* The final merge; rebuild prev links */
     struct list_head *stk0 = tp, *stk1 = stk0->prev;
     while (stk1 && stk1->prev)
         stk0 = stk0->prev, stk1 = stk1->prev;
     if (stk_size <= 1) {
-        build_prev_link(head, head, stk0);
+        trace_sort_merge_final(run_size(stk0), 0);
+        build_prev_link(priv, cmp, head, head, stk0);
         return;
     }
+    trace_sort_merge_final(run_size(stk1), run_size(stk0));
+    sort_stat_cost(run_size(stk1) + run_size(stk0));
     merge_final(priv, cmp, head, stk1, stk0);
 }
@@ -0,0 +1,363 @@
+#include <linux/kernel.h>
+#include <linux/bug.h>
+#include <linux/compiler.h>
+#include <linux/export.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/string.h>
+#include <linux/list.h>
+
+#include "sort.h"
+#include "sort_trace.h"
+
+/* The time-sliced timsort: the runs and the merge policy of `timsort_merge`,
+ * but every loop over the nodes can stop when the budget of a call runs out,
+ * keeping its cursor in `struct timsort_slice`. The list is in pieces between
+ * the calls, and may only be touched again once timsort_slice() returns true.
+ *
+ * Every node scanned, merged or relinked takes one unit of the budget.
+ */
+
+static uint slice_nodes = 4096;
+module_param(slice_nodes, uint, 0644);
+MODULE_PARM_DESC(slice_nodes,
+                 "Nodes processed by each slice of timsort_sliced (>= 1)");
+
+enum {
+    SLICE_RUN,      /* scanning the next run of the input */
+    SLICE_COLLAPSE, /* picking the next merge of the run stack */
+    SLICE_MERGE,    /* merging two runs of the stack */
+    SLICE_FINAL,    /* the final merge, rebuilding the prev links */
+    SLICE_LINK,     /* rebuilding the prev links of the rest */
+    SLICE_DONE,
+};
+
+static inline size_t run_size(struct list_head *head)
+{
+    if (!head)
+        return 0;
+    if (!head->next)
+        return 1;
+    return (size_t) (head->next->prev);
+}
+
+void timsort_slice_init(struct timsort_slice *st, struct list_head *head)
+{
+    memset(st, 0, sizeof(*st));
+    st->head = head;
+    if (list_empty(head) || list_is_singular(head)) {
+        st->step = SLICE_DONE;
+        return;
+    }
+
+    /* Convert to a null-terminated singly-linked list. */
+    head->prev->next = NULL;
+    st->list = head->next;
+    st->step = SLICE_RUN;
+}
+
+/* Scan the run starting at `st->list`, reversing it if it is strictly
+ * descending. Returns false if the budget ran out first. */
+static bool slice_run(void *priv,
+                      list_cmp_func_t cmp,
+                      struct timsort_slice *st,
+                      size_t *budget)
+{
+    if (!st->run) {
+        st->run = st->cur = st->list;
+        st->list = st->list->next;
+        st->run_len = 1;
+        st->descending = false;
+        sort_stat_phase(SORT_PHASE_RUN_DETECT);
+        if (st->list && cmp(priv, st->cur, st->list) > 0) {
+            /* decending run, also reverse the list */
+            st->descending = true;
+            st->run->next = NULL;
+            sort_stat_phase(SORT_PHASE_RUN_REVERSE);
+        }
+    }
+
+    /* the order of the first two nodes is known from above */
+    while (st->list) {
+        struct list_head *next = st->list;
+
+        if (!*budget)
+            return false;
+        if (st->run_len > 1 &&
+            (cmp(priv, st->cur, next) > 0) != st->descending)
+            break;
+        (*budget)--;
+
+        st->list = next->next;
+        if (st->descending) {
+            next->next = st->run;
+            st->run = next;
+            sort_stat_work(1, 1);
+        } else {
+            sort_stat_work(1, 0);
+        }
+        st->cur = next;
+        st->run_len++;
+    }
+    if (!st->descending)
+        st->cur->next = NULL;
+
+    trace_sort_run_found(st->run_len, st->descending, st->run_len);
+    st->run->prev = st->tp;
+    if (st->run->next)
+        st->run->next->prev = (struct list_head *) st->run_len;
+    st->tp = st->run;
+    st->stk_size++;
+    st->run = NULL;
+    return true;
+}
+
+/* Start merging the run `at` into the one below it */
+static void slice_merge_start(struct timsort_slice *st, struct list_head *at)
+{
+    size_t left = run_size(at->prev), right = run_size(at);
+
+    trace_sort_merge_at(left, right, st->stk_size, 0);
+    sort_stat_cost(left + right);
+    sort_stat_phase(SORT_PHASE_MERGE);
+    st->above = at == st->tp ? NULL : st->tp;
+    st->below = at->prev->prev;
+    st->merge_len = left + right;
+    st->a = at->prev;
+    st->b = at;
+    st->merged = NULL;
+    st->tail = &st->merged;
+    st->step = SLICE_MERGE;
+}
+
+/* Pick the next merge of the run stack by the rules of merge_collapse(), or of
+ * merge_force_collapse() at the end of the input */
+static void slice_collapse(struct timsort_slice *st)
+{
+    struct list_head *tp = st->tp;
+    size_t n = st->stk_size;
+
+    if (!st->list) {
+        if (n >= 3) {
+            slice_merge_start(st, run_size(tp->prev->prev) < run_size(tp)
+                                      ? tp->prev
+                                      : tp);
+            return;
+        }
+
+        /* The final merge; rebuild prev links */
+        sort_stat_phase(SORT_PHASE_MERGE_FINAL);
+        st->tail = NULL;
+        st->link_tail = st->head;
+        if (n <= 1) {
+            trace_sort_merge_final(run_size(tp), 0);
+            st->list = tp;
+            st->step = SLICE_LINK;
+            return;
+        }
+        trace_sort_merge_final(run_size(tp->prev), run_size(tp));
+        sort_stat_cost(run_size(tp->prev) + run_size(tp));
+        st->a = tp->prev;
+        st->b = tp;
+        st->step = SLICE_FINAL;
+        return;
+    }
+
+    if (n >= 2) {
+        if ((n >= 3 &&
+             run_size(tp->prev->prev) <= run_size(tp->prev) + run_size(tp)) ||
+            (n >= 4 && run_size(tp->prev->prev->prev) <=
+                           run_size(tp->prev->prev) + run_size(tp->prev))) {
+            slice_merge_start(st, run_size(tp->prev->prev) < run_size(tp)
+                                      ? tp->prev
+                                      : tp);
+            return;
+        }
+        if (run_size(tp->prev) <= run_size(tp)) {
+            slice_merge_start(st, tp);
+            return;
+        }
+    }
+    st->step = SLICE_RUN;
+}
+
+static bool slice_merge(void *priv,
+                        list_cmp_func_t cmp,
+                        struct timsort_slice *st,
+                        size_t *budget)
+{
+    struct list_head *a = st->a, *b = st->b, **tail = st->tail;
+
+    for (;;) {
+        if (!*budget) {
+            st->a = a, st->b = b, st->tail = tail;
+            return false;
+        }
+        (*budget)--;
+
+        /* if equal, take 'a' -- important for sort stability */
+        if (cmp(priv, a, b) <= 0) {
+            *tail = a;
+            tail = &a->next;
+            a = a->next;
+            sort_stat_work(1, 1);
+            if (!a) {
+                *tail = b;
+                break;
+            }
+        } else {
+            *tail = b;
+            tail = &b->next;
+            b = b->next;
+            sort_stat_work(1, 1);
+            if (!b) {
+                *tail = a;
+                break;
+            }
+        }
+    }
+
+    struct list_head *list = st->merged;
+    list->prev = st->below;
+    list->next->prev = (struct list_head *) st->merge_len;
+    if (st->above)
+        st->above->prev = list;
+    else
+        st->tp = list;
+    st->stk_size--;
+    st->step = SLICE_COLLAPSE;
+    return true;
+}
+
+static bool slice_final(void *priv,
+                        list_cmp_func_t cmp,
+                        struct timsort_slice *st,
+                        size_t *budget)
+{
+    struct list_head *a = st->a, *b = st->b, *tail = st->link_tail;
+
+    for (;;) {
+        if (!*budget) {
+            st->a = a, st->b = b, st->link_tail = tail;
+            return false;
+        }
+        (*budget)--;
+
+        /* if equal, take 'a' -- important for sort stability */
+        if (cmp(priv, a, b) <= 0) {
+            tail->next = a;
+            a->prev = tail;
+            tail = a;
+            a = a->next;
+            sort_stat_work(1, 2);
+            if (!a)
+                break;
+        } else {
+            tail->next = b;
+            b->prev = tail;
+            tail = b;
+            b = b->next;
+            sort_stat_work(1, 2);
+            if (!b) {
+                b = a;
+                break;
+            }
+        }
+    }
+
+    /* Finish linking remainder of list b on to tail */
+    st->list = b;
+    st->link_tail = tail;
+    st->step = SLICE_LINK;
+    return true;
+}
+
+static bool slice_link(struct timsort_slice *st, size_t *budget)
+{
+    struct list_head *list = st->list, *tail = st->link_tail;
+
+    while (list) {
+        if (!*budget) {
+            st->list = list, st->link_tail = tail;
+            return false;
+        }
+        (*budget)--;
+
+        tail->next = list;
+        list->prev = tail;
+        tail = list;
+        list = list->next;
+        sort_stat_work(1, 2);
+    }
+
+    /* The final links to make a circular doubly-linked list */
+    tail->next = st->head;
+    st->head->prev = tail;
+    st->step = SLICE_DONE;
+    return true;
+}
+
+/* Sort on for at most `budget` nodes, returning true once the list is
+ * sorted */
+bool timsort_slice(void *priv,
+                   list_cmp_func_t cmp,
+                   struct timsort_slice *st,
+                   size_t budget)
+{
+    for (;;) {
+        switch (st->step) {
+        case SLICE_RUN:
+            if (!slice_run(priv, cmp, st, &budget))
+                return false;
+            st->step = SLICE_COLLAPSE;
+            break;
+        case SLICE_COLLAPSE:
+            slice_collapse(st);
+            break;
+        case SLICE_MERGE:
+            if (!slice_merge(priv, cmp, st, &budget))
+                return false;
+            break;
+        case SLICE_FINAL:
+            if (!slice_final(priv, cmp, st, &budget))
+                return false;
+            break;
+        case SLICE_LINK:
+            if (!slice_link(st, &budget))
+                return false;
+            break;
+        default:
+            return true;
+        }
+    }
+}
+
+/* A node the sort stopped at, which is in the list as any step only runs out
+ * of budget before one */
+static struct list_head *slice_node(const struct timsort_slice *st)
+{
+    if (st->step == SLICE_MERGE || st->step == SLICE_FINAL)
+        return st->a;
+    return st->list;
+}
+
+/* The whole sort in slices of `slice_nodes` nodes. Between the slices, where a
+ * real caller would leave its atomic section, cmp() is called back with a node
+ * of the list, as list_sort() does, so the test driver can reschedule. */
+void timsort_sliced(void *priv, struct list_head *head, list_cmp_func_t cmp)
+{
+    struct timsort_slice st;
+    size_t budget = max(slice_nodes, 1U);
+
+    /* Few distinct keys; bucket the equal nodes as timsort_merge() does, in
+     * one go */
+    if (lowcard_fallback && lowcard_sort_try(priv, head, cmp))
+        return;
+
+    timsort_slice_init(&st, head);
+    while (!timsort_slice(priv, cmp, &st, budget)) {
+        struct list_head *node = slice_node(&st);
+
+        cmp(priv, node, node);
+    }
+}
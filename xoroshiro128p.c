@@ -9,6 +9,8 @@
 
 #include <linux/types.h>
 
+#include "xoroshiro128p.h"
+
 /*
  * This is xoroshiro128+ 1.0, our best and fastest small-state generator
  * for floating-point numbers. We suggest to use its upper bits for
@@ -37,48 +39,86 @@ static inline uint64_t rotl(const uint64_t x, int k)
     return (x << k) | (x >> (64 - k));
 }
 
-static uint64_t s[2];
+/* splitmix64, which fills the state from a 64-bit seed as suggested above */
+static uint64_t splitmix64(uint64_t *x)
+{
+    uint64_t z = (*x += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+}
 
-void seed(uint64_t s0, uint64_t s1)
+void xoro_seed(struct xoro_state *st, uint64_t seed)
 {
-    s[0] = s0;
-    s[1] = s1;
-    return;
+    st->s[0] = splitmix64(&seed);
+    st->s[1] = splitmix64(&seed);
 }
 
-uint64_t next(void)
+uint64_t xoro_next(struct xoro_state *st)
 {
-    const uint64_t s0 = s[0];
-    uint64_t s1 = s[1];
+    const uint64_t s0 = st->s[0];
+    uint64_t s1 = st->s[1];
     const uint64_t result = s0 + s1;
 
     s1 ^= s0;
-    s[0] = rotl(s0, 24) ^ s1 ^ (s1 << 16);  // a, b
-    s[1] = rotl(s1, 37);                    // c
+    st->s[0] = rotl(s0, 24) ^ s1 ^ (s1 << 16);  // a, b
+    st->s[1] = rotl(s1, 37);                    // c
 
     return result;
 }
 
-/* This is the jump function for the generator. It is equivalent
- * to 2^64 calls to next(); it can be used to generate 2^64
- * non-overlapping subsequences for parallel computations.
- */
-void jump(void)
+static void xoro_jump_by(struct xoro_state *st, const uint64_t *poly)
 {
-    static const uint64_t JUMP[] = {0xdf900294d8f554a5, 0x170865df4b3201fc};
-
     uint64_t s0 = 0;
     uint64_t s1 = 0;
     int i, b;
-    for (i = 0; i < sizeof JUMP / sizeof *JUMP; i++)
+    for (i = 0; i < 2; i++)
         for (b = 0; b < 64; b++) {
-            if (JUMP[i] & (uint64_t)(1) << b) {
-                s0 ^= s[0];
-                s1 ^= s[1];
+            if (poly[i] & (uint64_t)(1) << b) {
+                s0 ^= st->s[0];
+                s1 ^= st->s[1];
             }
-            next();
+            xoro_next(st);
         }
 
-    s[0] = s0;
-    s[1] = s1;
-}
\ No newline at end of file
+    st->s[0] = s0;
+    st->s[1] = s1;
+}
+
+/* This is the jump function for the generator. It is equivalent
+ * to 2^64 calls to next(); it can be used to generate 2^64
+ * non-overlapping subsequences for parallel computations.
+ */
+void xoro_jump(struct xoro_state *st)
+{
+    static const uint64_t JUMP[] = {0xdf900294d8f554a5, 0x170865df4b3201fc};
+
+    xoro_jump_by(st, JUMP);
+}
+
+/* This is the long-jump function for the generator. It is equivalent to
+ * 2^96 calls to next(); it can be used to generate 2^32 starting points,
+ * from each of which jump() will generate 2^32 non-overlapping
+ * subsequences for parallel distributed computations.
+ */
+void xoro_long_jump(struct xoro_state *st)
+{
+    static const uint64_t LONG_JUMP[] = {0xd2a98b26625eee7b, 0xdddf9b1090aa7ac1};
+
+    xoro_jump_by(st, LONG_JUMP);
+}
+
+/* The stream of the samples of `iteration` run on the worker `cpu`: the streams
+ * of the workers are 2^96 numbers apart, and the iterations of a worker take
+ * the streams 2^64 numbers apart in it */
+void xoro_stream(struct xoro_state *st,
+                 uint64_t seed,
+                 unsigned int iteration,
+                 unsigned int cpu)
+{
+    xoro_seed(st, seed);
+    while (cpu--)
+        xoro_long_jump(st);
+    while (iteration--)
+        xoro_jump(st);
+}
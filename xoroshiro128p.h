@@ -0,0 +1,21 @@
+#ifndef XOROSHIRO128P_H
+#define XOROSHIRO128P_H
+
+#include <linux/types.h>
+
+/* The state of a xoroshiro128+ stream, so that every test and every worker
+ * draws its samples from a stream of its own */
+struct xoro_state {
+    uint64_t s[2];
+};
+
+void xoro_seed(struct xoro_state *st, uint64_t seed);
+uint64_t xoro_next(struct xoro_state *st);
+void xoro_jump(struct xoro_state *st);
+void xoro_long_jump(struct xoro_state *st);
+void xoro_stream(struct xoro_state *st,
+                 uint64_t seed,
+                 unsigned int iteration,
+                 unsigned int cpu);
+
+#endif